@@ -0,0 +1,135 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "data.hpp"
+
+namespace ldnn {
+
+    // Reads a csv file on a background thread and publishes the parsed
+    // vectors in chunks, so that the consumer can process the beginning of
+    // the file while the rest of it is still being parsed.
+    template<class T>
+    class async_csv_reader {
+    public:
+        async_csv_reader(const std::string& filename, char delimiter,
+            size_t chunk_size = 4096)
+            : file(filename), delimiter(delimiter), chunk_size(chunk_size)
+        {
+            if (!file.is_open()) {
+                throw std::invalid_argument{"File couldn't be opened!"};
+            }
+            if (chunk_size == 0) {
+                throw std::invalid_argument{"chunk_size == 0"};
+            }
+            producer = std::thread{[this] { produce(); }};
+        }
+
+        async_csv_reader(const async_csv_reader&) = delete;
+        async_csv_reader& operator=(const async_csv_reader&) = delete;
+
+        ~async_csv_reader() {
+            {
+                auto lock = std::unique_lock<std::mutex>{mutex};
+                stopped = true;
+            }
+            changed.notify_all();
+            producer.join();
+        }
+
+        // Moves the next chunk into chunk. Returns false when the whole file
+        // has been consumed. Errors of the background thread are rethrown.
+        auto next_chunk(std::vector<vector<T>>& chunk)
+            -> bool
+        {
+            auto lock = std::unique_lock<std::mutex>{mutex};
+            changed.wait(lock, [&] { return !chunks.empty() || done; });
+            if (chunks.empty()) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                return false;
+            }
+            chunk = std::move(chunks.front());
+            chunks.pop_front();
+            lock.unlock();
+            changed.notify_all();
+            return true;
+        }
+
+    private:
+        // Maximum number of parsed chunks that may wait for the consumer.
+        static constexpr size_t max_pending = 16;
+
+        void produce() {
+            try {
+                auto rank = rank_t{0};
+                auto chunk = std::vector<vector<T>>{};
+                for (auto line = std::string{}; std::getline(file, line); ) {
+                    auto vec = parse_csv_line<T>(line, delimiter);
+                    if (is_nan_vector(vec)) {
+                        continue;
+                    }
+                    if (rank.value == 0) {
+                        rank = vec.rank();
+                    } else if (vec.rank() != rank) {
+                        throw std::invalid_argument{
+                            "the data contains vectors of different lengths"};
+                    }
+                    chunk.push_back(std::move(vec));
+                    if (chunk.size() == chunk_size && !publish(chunk)) {
+                        return;
+                    }
+                }
+                if (chunk.size() > 0) {
+                    publish(chunk);
+                }
+            } catch (...) {
+                auto lock = std::unique_lock<std::mutex>{mutex};
+                error = std::current_exception();
+            }
+            {
+                auto lock = std::unique_lock<std::mutex>{mutex};
+                done = true;
+            }
+            changed.notify_all();
+        }
+
+        auto publish(std::vector<vector<T>>& chunk)
+            -> bool
+        {
+            auto lock = std::unique_lock<std::mutex>{mutex};
+            changed.wait(lock,
+                [&] { return chunks.size() < max_pending || stopped; });
+            if (stopped) {
+                return false;
+            }
+            chunks.push_back(std::move(chunk));
+            chunk.clear();
+            lock.unlock();
+            changed.notify_all();
+            return true;
+        }
+
+    private:
+        std::ifstream file;
+        char delimiter;
+        size_t chunk_size;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::vector<vector<T>>> chunks;
+        std::exception_ptr error;
+        bool done = false;
+        bool stopped = false;
+
+        std::thread producer;
+    };
+
+} // namespace ldnn
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ldnn/vector.hpp"
+
+namespace ldnn {
+
+    // A binary alternative to the csv files that loads without parsing:
+    // the magic "LDNNBIN1", the number of rows and of columns as uint64
+    // and then all values as row-major doubles, in host byte order.
+    namespace binary_format {
+
+        constexpr char magic[8] = {'L', 'D', 'N', 'N', 'B', 'I', 'N', '1'};
+
+        inline void write_header(std::ostream& o, uint64_t rows,
+            uint64_t columns)
+        {
+            o.write(magic, sizeof(magic));
+            o.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+            o.write(reinterpret_cast<const char*>(&columns), sizeof(columns));
+        }
+
+        inline void write_row(std::ostream& o, const double* values,
+            size_t columns)
+        {
+            o.write(reinterpret_cast<const char*>(values),
+                static_cast<std::streamsize>(columns * sizeof(double)));
+        }
+
+    } // namespace binary_format
+
+    // Calls f with the ldnn::vector<T> of every row of data in the binary
+    // format as soon as it is read, so that the data doesn't have to be
+    // held as a whole.
+    template<class T, class F>
+    void for_each_binary_row(std::istream& i, F&& f)
+    {
+        char magic[sizeof(binary_format::magic)];
+        auto rows = uint64_t{0};
+        auto columns = uint64_t{0};
+        i.read(magic, sizeof(magic));
+        i.read(reinterpret_cast<char*>(&rows), sizeof(rows));
+        i.read(reinterpret_cast<char*>(&columns), sizeof(columns));
+        if (!i || std::memcmp(magic, binary_format::magic, sizeof(magic)) != 0) {
+            throw std::invalid_argument{"invalid binary data header"};
+        }
+
+        auto row = std::vector<double>(columns);
+        for (auto r = rows; r-- > 0; ) {
+            i.read(reinterpret_cast<char*>(row.data()),
+                static_cast<std::streamsize>(columns * sizeof(double)));
+            if (!i) {
+                throw std::invalid_argument{"binary data is truncated"};
+            }
+            auto vec = vector<T>{rank_t{columns}};
+            std::copy(begin(row), end(row), vec.begin());
+            f(std::move(vec));
+        }
+    }
+
+    // Reads data in the binary format, with the same result as reading the
+    // equivalent csv file with read_csv_data.
+    template<class T>
+    auto read_binary_data(std::istream& i)
+        -> std::vector<vector<T>>
+    {
+        auto vecs = std::vector<vector<T>>{};
+        for_each_binary_row<T>(i,
+            [&](vector<T>&& vec) { vecs.push_back(std::move(vec)); });
+        return vecs;
+    }
+
+    template<class T>
+    auto read_binary_file(const std::string& filename)
+        -> std::vector<vector<T>>
+    {
+        auto file = std::ifstream(filename, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::invalid_argument{"File couldn't be opened!"};
+        }
+        return read_binary_data<T>(file);
+    }
+
+} // namespace ldnn
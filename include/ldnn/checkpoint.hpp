@@ -0,0 +1,288 @@
+#pragma once
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "util/random.hpp"
+
+#include "network.hpp"
+
+namespace ldnn {
+
+    // The training progress of a cross validation round after epoch
+    // completed epochs, with the generator all random streams of the run
+    // are derived from.
+    template<class T = double>
+    struct checkpoint {
+        uint64_t iteration;
+        uint64_t epoch;
+
+        // Hash of everything the progress depends on, e.g. the seed, the
+        // settings and the dataset, so that a checkpoint of another run
+        // isn't resumed.
+        uint64_t run_hash;
+
+        util::philox4x32 rng;
+        std::vector<T> parameters;
+        typename optimizer<T>::state_t optimizer;
+
+        // The last errors of the importance sampler, empty without it.
+        std::vector<T> sample_errors;
+    };
+
+    namespace detail {
+
+        constexpr char checkpoint_magic[8] =
+            {'L', 'D', 'N', 'N', 'C', 'K', 'P', '2'};
+
+        inline void write_u64(std::ostream& o, uint64_t value) {
+            o.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+
+        inline auto read_u64(std::istream& i)
+            -> uint64_t
+        {
+            auto value = uint64_t{0};
+            i.read(reinterpret_cast<char*>(&value), sizeof(value));
+            return value;
+        }
+
+        template<class T>
+        void write_values(std::ostream& o, const std::vector<T>& values) {
+            write_u64(o, values.size());
+            o.write(reinterpret_cast<const char*>(values.data()),
+                static_cast<std::streamsize>(values.size() * sizeof(T)));
+        }
+
+        template<class T>
+        auto read_values(std::istream& i)
+            -> std::vector<T>
+        {
+            auto values = std::vector<T>(read_u64(i));
+            i.read(reinterpret_cast<char*>(values.data()),
+                static_cast<std::streamsize>(values.size() * sizeof(T)));
+            return values;
+        }
+
+    } // namespace detail
+
+    // Writes c in host byte order: the magic "LDNNCKP2", sizeof(T), the
+    // iteration, epoch and run hash, the generator in its text form and then the
+    // parameters, the optimizer state and the sample errors.
+    template<class T>
+    void write_checkpoint(std::ostream& o, const checkpoint<T>& c) {
+        o.write(detail::checkpoint_magic, sizeof(detail::checkpoint_magic));
+        detail::write_u64(o, sizeof(T));
+        detail::write_u64(o, c.iteration);
+        detail::write_u64(o, c.epoch);
+        detail::write_u64(o, c.run_hash);
+        auto rng = std::ostringstream{};
+        rng << c.rng;
+        detail::write_u64(o, rng.str().size());
+        o.write(rng.str().data(),
+            static_cast<std::streamsize>(rng.str().size()));
+        detail::write_values(o, c.parameters);
+        detail::write_u64(o, c.optimizer.step);
+        detail::write_u64(o, c.optimizer.epoch);
+        detail::write_values(o, c.optimizer.first_moment);
+        detail::write_values(o, c.optimizer.second_moment);
+        detail::write_values(o, c.sample_errors);
+    }
+
+    template<class T>
+    auto read_checkpoint(std::istream& i)
+        -> checkpoint<T>
+    {
+        char magic[sizeof(detail::checkpoint_magic)];
+        i.read(magic, sizeof(magic));
+        if (!i || std::memcmp(magic, detail::checkpoint_magic,
+                sizeof(magic)) != 0) {
+            throw std::invalid_argument{"invalid checkpoint header"};
+        }
+        if (detail::read_u64(i) != sizeof(T)) {
+            throw std::invalid_argument{"checkpoint has another value type"};
+        }
+
+        auto c = checkpoint<T>{0, 0, 0, util::philox4x32{0}, {}, {}, {}};
+        c.iteration = detail::read_u64(i);
+        c.epoch = detail::read_u64(i);
+        c.run_hash = detail::read_u64(i);
+        auto rng = std::string(detail::read_u64(i), ' ');
+        i.read(&rng[0], static_cast<std::streamsize>(rng.size()));
+        auto rng_stream = std::istringstream{rng};
+        rng_stream >> c.rng;
+        c.parameters = detail::read_values<T>(i);
+        c.optimizer.step = detail::read_u64(i);
+        c.optimizer.epoch = detail::read_u64(i);
+        c.optimizer.first_moment = detail::read_values<T>(i);
+        c.optimizer.second_moment = detail::read_values<T>(i);
+        c.sample_errors = detail::read_values<T>(i);
+        if (!i || !rng_stream) {
+            throw std::invalid_argument{"checkpoint is truncated"};
+        }
+        return c;
+    }
+
+    template<class T>
+    auto read_checkpoint_file(const std::string& filename)
+        -> checkpoint<T>
+    {
+        auto file = std::ifstream{filename, std::ios::binary};
+        if (!file.is_open()) {
+            throw std::invalid_argument{filename + " couldn't be opened!"};
+        }
+        return read_checkpoint<T>(file);
+    }
+
+// Writes checkpoints to a file on a background thread, so that training
+// only pays for copying the snapshot. Every checkpoint is written to
+// filename.tmp and then renamed to filename, so a process that is killed
+// while writing leaves the previous checkpoint intact. If training saves
+// faster than the checkpoints can be written, only the latest pending one
+// is kept.
+template<class T = double>
+class checkpoint_writer {
+public:
+    explicit checkpoint_writer(std::string filename)
+        : filename(std::move(filename)), thread([this] { run(); })
+    {}
+
+    checkpoint_writer(const checkpoint_writer&) = delete;
+    checkpoint_writer& operator=(const checkpoint_writer&) = delete;
+
+    // Writes the pending checkpoint before returning.
+    ~checkpoint_writer() {
+        {
+            auto lock = std::unique_lock<std::mutex>{mutex};
+            stopping = true;
+        }
+        changed.notify_all();
+        thread.join();
+    }
+
+    // Queues c for writing. Throws if the previous write failed.
+    void save(checkpoint<T> c) {
+        {
+            auto lock = std::unique_lock<std::mutex>{mutex};
+            rethrow();
+            pending = std::make_unique<checkpoint<T>>(std::move(c));
+        }
+        changed.notify_all();
+    }
+
+    // Blocks until all saved checkpoints are written. Throws if the last
+    // write failed.
+    void flush() {
+        auto lock = std::unique_lock<std::mutex>{mutex};
+        changed.wait(lock, [&] { return !pending && !writing; });
+        rethrow();
+    }
+
+private:
+    void run() {
+        auto lock = std::unique_lock<std::mutex>{mutex};
+        while (true) {
+            changed.wait(lock, [&] { return pending || stopping; });
+            if (!pending) {
+                return;
+            }
+            auto c = std::move(pending);
+            writing = true;
+            lock.unlock();
+            auto message = write(*c);
+            lock.lock();
+            writing = false;
+            error = message;
+            changed.notify_all();
+        }
+    }
+
+    // Must be called with the mutex locked.
+    void rethrow() {
+        if (error.size() > 0) {
+            auto message = std::move(error);
+            error.clear();
+            throw std::runtime_error{message};
+        }
+    }
+
+    // Returns an error message, or an empty string on success. The
+    // checkpoint and the directory entry of the rename are synced to disk,
+    // so that a crash leaves either the previous or the new checkpoint.
+    auto write(const checkpoint<T>& c)
+        -> std::string
+    {
+        auto buffer = std::ostringstream{};
+        write_checkpoint(buffer, c);
+        auto data = buffer.str();
+
+        auto tmp = filename + ".tmp";
+        auto fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return "opening " + tmp + " failed: " + std::strerror(errno);
+        }
+        for (size_t written = 0; written < data.size(); ) {
+            auto n = ::write(fd, data.data() + written, data.size() - written);
+            if (n < 0 && errno != EINTR) {
+                auto message = "writing " + tmp + " failed: "
+                    + std::strerror(errno);
+                ::close(fd);
+                return message;
+            }
+            if (n > 0) {
+                written += static_cast<size_t>(n);
+            }
+        }
+        if (::fsync(fd) != 0) {
+            auto message = "syncing " + tmp + " failed: "
+                + std::strerror(errno);
+            ::close(fd);
+            return message;
+        }
+        if (::close(fd) != 0) {
+            return "closing " + tmp + " failed: " + std::strerror(errno);
+        }
+        if (std::rename(tmp.c_str(), filename.c_str()) != 0) {
+            return "renaming " + tmp + " failed: " + std::strerror(errno);
+        }
+
+        auto slash = filename.rfind('/');
+        auto directory = slash == std::string::npos ? std::string{"."}
+            : slash == 0 ? std::string{"/"} : filename.substr(0, slash);
+        auto dir_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir_fd < 0) {
+            return "opening " + directory + " failed: " + std::strerror(errno);
+        }
+        auto synced = ::fsync(dir_fd) == 0;
+        auto message = synced ? std::string{}
+            : "syncing " + directory + " failed: " + std::strerror(errno);
+        ::close(dir_fd);
+        return message;
+    }
+
+private:
+    std::string filename;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::unique_ptr<checkpoint<T>> pending;
+    bool writing = false;
+    bool stopping = false;
+    std::string error;
+    std::thread thread;
+};
+
+} // namespace ldnn
@@ -0,0 +1,362 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include "ldnn/vector.hpp"
+
+namespace ldnn {
+
+    // Encodings of features in fewer bits. Each one converts values to its
+    // storage type one at a time and back in blocks, so that the decoding
+    // loops can use vector instructions.
+
+    // Doubles as they are, for matrices that only differ in where their
+    // rows are stored.
+    struct float64 {
+        using storage_type = double;
+        using value_type = double;
+
+        static auto encode(double x)
+            -> double
+        {
+            return x;
+        }
+
+        static void decode(const double* in, double* out, size_t n) {
+            std::copy(in, in + n, out);
+        }
+    };
+
+    // IEEE 754 half precision: 1 sign, 5 exponent and 10 mantissa bits.
+    // Uses the F16C instructions if they are enabled.
+    struct float16 {
+        using storage_type = uint16_t;
+        using value_type = float;
+
+        static auto encode(float x)
+            -> uint16_t
+        {
+#if defined(__F16C__)
+            return _cvtss_sh(x, _MM_FROUND_TO_NEAREST_INT);
+#else
+            return encode_scalar(x);
+#endif
+        }
+
+        static void decode(const uint16_t* in, float* out, size_t n) {
+            auto k = size_t{0};
+#if defined(__F16C__)
+            for (; k + 8 <= n; k += 8) {
+                _mm256_storeu_ps(out + k, _mm256_cvtph_ps(_mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(in + k))));
+            }
+#endif
+            for (; k < n; ++k) {
+                out[k] = decode_scalar(in[k]);
+            }
+        }
+
+        // Rounds to the nearest representable value, ties to even.
+        static auto encode_scalar(float x)
+            -> uint16_t
+        {
+            auto f = uint32_t{0};
+            std::memcpy(&f, &x, sizeof(f));
+            auto sign = static_cast<uint16_t>((f >> 16) & 0x8000u);
+            auto bits = f & 0x7fffffffu;
+            if (bits >= 0x7f800000u) {
+                // inf stays inf, NaNs become quiet NaNs
+                return sign | (bits > 0x7f800000u ? 0x7e00u : 0x7c00u);
+            }
+            if (bits >= 0x477ff000u) {
+                // at least 65520, which rounds to inf
+                return sign | 0x7c00u;
+            }
+            if (bits < 0x38800000u) {
+                // below 2^-14, a subnormal in units of 2^-24
+                auto a = float{0};
+                std::memcpy(&a, &bits, sizeof(a));
+                return sign | static_cast<uint16_t>(
+                    std::nearbyint(a * 16777216.0f));
+            }
+            bits += 0xfffu + ((bits >> 13) & 1u);
+            return sign | static_cast<uint16_t>((bits - 0x38000000u) >> 13);
+        }
+
+        static auto decode_scalar(uint16_t h)
+            -> float
+        {
+            auto sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+            auto exponent = (h >> 10) & 0x1fu;
+            auto mantissa = static_cast<uint32_t>(h & 0x3ffu);
+            auto bits = uint32_t{0};
+            if (exponent == 0) {
+                auto value = mantissa * 5.9604644775390625e-8f;
+                std::memcpy(&bits, &value, sizeof(bits));
+                bits |= sign;
+            } else if (exponent == 0x1f) {
+                bits = sign | 0x7f800000u | (mantissa << 13);
+            } else {
+                bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+            }
+            auto result = float{0};
+            std::memcpy(&result, &bits, sizeof(result));
+            return result;
+        }
+    };
+
+    // The upper half of a float: 1 sign, 8 exponent and 7 mantissa bits.
+    // It has the range of a float, so decoding is a shift.
+    struct bfloat16 {
+        using storage_type = uint16_t;
+        using value_type = float;
+
+        // Rounds to the nearest representable value, ties to even.
+        static auto encode(float x)
+            -> uint16_t
+        {
+            auto f = uint32_t{0};
+            std::memcpy(&f, &x, sizeof(f));
+            if ((f & 0x7fffffffu) > 0x7f800000u) {
+                return static_cast<uint16_t>((f >> 16) | 0x40u);
+            }
+            f += 0x7fffu + ((f >> 16) & 1u);
+            return static_cast<uint16_t>(f >> 16);
+        }
+
+        static void decode(const uint16_t* in, float* out, size_t n) {
+            for (size_t k = 0; k < n; ++k) {
+                auto bits = static_cast<uint32_t>(in[k]) << 16;
+                std::memcpy(out + k, &bits, sizeof(bits));
+            }
+        }
+    };
+
+    // Fixed point values in [0, 1] in steps of 1/255, for normalized
+    // features. Values outside [0, 1] are clamped.
+    struct fixed8 {
+        using storage_type = uint8_t;
+        using value_type = float;
+
+        static auto encode(float x)
+            -> uint8_t
+        {
+            return static_cast<uint8_t>(
+                std::nearbyint(std::min(std::max(x, 0.0f), 1.0f) * 255.0f));
+        }
+
+        static void decode(const uint8_t* in, float* out, size_t n) {
+            for (size_t k = 0; k < n; ++k) {
+                out[k] = in[k] * (1.0f / 255.0f);
+            }
+        }
+    };
+
+    // A row of a compact_matrix, its features are encoded with E.
+    template<class E>
+    struct compact_row {
+        using storage_type = typename E::storage_type;
+        using value_type = typename E::value_type;
+
+        compact_row(rank_t rank, const storage_type* data)
+            : data(data), rank_(rank)
+        {}
+
+        auto rank() const noexcept
+            -> rank_t
+        {
+            return rank_;
+        }
+
+        // Decodes the features [first, first + n) into out.
+        void decode(size_t first, value_type* out, size_t n) const {
+            E::decode(data + first, out, n);
+        }
+
+        const storage_type* data;
+
+    private:
+        rank_t rank_;
+    };
+
+    // Dense vectors of the same rank whose features are stored with the
+    // encoding E, row after row in Rows. With 16 bit encodings, the matrix
+    // takes a quarter of the memory of vector<double> rows, with fixed8 an
+    // eighth. Rows other than std::vector, e.g. util::shared_array, can
+    // refer to rows that are stored elsewhere and only be read.
+    template<class E, class Rows = std::vector<typename E::storage_type>>
+    class compact_matrix {
+    public:
+        using storage_type = typename E::storage_type;
+
+        compact_matrix() = default;
+
+        // Refers to the rows of the given rank in data.
+        compact_matrix(rank_t rank, Rows data)
+            : rank_(rank),
+              size_(rank.value == 0 ? 0 : data.size() / rank.value),
+              data(std::move(data))
+        {}
+
+        template<class T, class A>
+        explicit compact_matrix(const std::vector<vector<T, A>>& rows) {
+            if (rows.size() > 0) {
+                data.reserve(rows.size() * rows[0].rank().value);
+            }
+            for (auto& row : rows) {
+                push_back(row);
+            }
+        }
+
+        // Reserves the storage of rows rows of the given rank.
+        void reserve(size_t rows, rank_t rank) {
+            data.reserve(rows * rank.value);
+        }
+
+        template<class T, class A>
+        void push_back(const vector<T, A>& row) {
+            if (size_ == 0 && data.size() == 0) {
+                rank_ = row.rank();
+            }
+            if (row.rank() != rank_) {
+                throw std::invalid_argument{"rank differs"};
+            }
+            for (auto x : row) {
+                data.push_back(E::encode(
+                    static_cast<typename E::value_type>(x)));
+            }
+            size_++;
+        }
+
+        auto operator[](size_t i) const
+            -> compact_row<E>
+        {
+            return {rank_, data.data() + i * rank_.value};
+        }
+
+        // Number of rows.
+        auto size() const
+            -> size_t
+        {
+            return size_;
+        }
+
+        auto rank() const
+            -> rank_t
+        {
+            return rank_;
+        }
+
+        // The encoded features, row after row.
+        auto rows() const
+            -> const Rows&
+        {
+            return data;
+        }
+
+        // Number of bytes of the encoded features.
+        auto storage_size() const
+            -> size_t
+        {
+            return data.size() * sizeof(storage_type);
+        }
+
+    private:
+        rank_t rank_ = {0};
+        size_t size_ = 0;
+        Rows data;
+    };
+
+    namespace detail {
+
+        // Number of features that are decoded at a time, small enough for
+        // the buffer to stay in L1.
+        constexpr size_t compact_block = 64;
+
+        // Calls f(first, decoded, n) for consecutive blocks of v.
+        template<class E, class F>
+        void for_each_block(const compact_row<E>& v, F&& f) {
+            typename E::value_type buffer[compact_block];
+            auto rank = v.rank().value;
+            for (size_t first = 0; first < rank; first += compact_block) {
+                auto n = std::min(compact_block, rank - first);
+                v.decode(first, buffer, n);
+                f(first, static_cast<const typename E::value_type*>(buffer),
+                    n);
+            }
+        }
+
+    } // namespace detail
+
+    // Dot product that decodes r block by block.
+    template<class T, class A, class E>
+    auto operator*(const vector<T, A>& l, const compact_row<E>& r)
+        -> T
+    {
+        if (l.rank() != r.rank())
+            throw std::invalid_argument{"rank differs"};
+
+        auto sum = T{0};
+        auto w = l.begin();
+        detail::for_each_block(r, [&](size_t first, const auto* x, size_t n) {
+            for (size_t k = 0; k < n; ++k) {
+                sum += w[first + k] * x[k];
+            }
+        });
+        return sum;
+    }
+
+    template<class T, class A, class E>
+    auto operator*(const compact_row<E>& l, const vector<T, A>& r)
+        -> T
+    {
+        return r * l;
+    }
+
+    template<class T, class A, class E>
+    auto operator+=(vector<T, A>& l, const compact_row<E>& r)
+        -> vector<T, A>&
+    {
+        if (l.rank() != r.rank())
+            throw std::invalid_argument{"rank differs"};
+
+        auto w = l.begin();
+        detail::for_each_block(r, [&](size_t first, const auto* x, size_t n) {
+            for (size_t k = 0; k < n; ++k) {
+                w[first + k] += x[k];
+            }
+        });
+        return l;
+    }
+
+    // Decodes v into out, which has the same rank.
+    template<class T, class A, class E>
+    void decode(const compact_row<E>& v, vector<T, A>& out) {
+        if (out.rank() != v.rank())
+            throw std::invalid_argument{"rank differs"};
+
+        auto w = out.begin();
+        detail::for_each_block(v, [&](size_t first, const auto* x, size_t n) {
+            std::copy(x, x + n, w + first);
+        });
+    }
+
+    template<class T = double, class E>
+    auto to_dense(const compact_row<E>& v)
+        -> vector<T>
+    {
+        auto result = vector<T>{v.rank()};
+        decode(v, result);
+        return result;
+    }
+
+} // namespace ldnn
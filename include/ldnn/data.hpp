@@ -1,57 +1,80 @@
 #pragma once
 
+#include <cerrno>
+#include <cstdlib>
 #include <iosfwd>
 #include <fstream>
+#include <limits>
 #include <string>
 #include <sstream>
 
 #include "network.hpp"
+#include "sparse_vector.hpp"
 
 namespace ldnn {
 
-    // Returns a range of ldnn::vector<T> created from the lines of the
-    // given std::istream
+    // Parses a single line of delimiter separated values. Values that can't
+    // be parsed are stored as NaN.
     template<class T>
-    auto read_csv_data(std::istream& i, char delimiter)
+    auto parse_csv_line(const std::string& line, char delimiter)
+        -> vector<T>
     {
-        auto vecs = std::vector<vector<T>>{};
-        for (auto line = std::string{}; std::getline(i, line); ) {
-            auto lnstr = std::stringstream{line};
-            auto dbls = std::vector<double>{};
-            for (auto word = std::string{};
-                std::getline(lnstr, word, delimiter); ) {
-                try {
-                    dbls.push_back(std::stod(word));
-                } catch(const std::invalid_argument&) {
-                    dbls.push_back(std::numeric_limits<double>::quiet_NaN());
-                }
+        auto lnstr = std::stringstream{line};
+        auto dbls = std::vector<double>{};
+        for (auto word = std::string{};
+            std::getline(lnstr, word, delimiter); ) {
+            try {
+                dbls.push_back(std::stod(word));
+            } catch(const std::invalid_argument&) {
+                dbls.push_back(std::numeric_limits<double>::quiet_NaN());
             }
-            vecs.push_back(vector<T>{dbls});
         }
+        return vector<T>{dbls};
+    }
 
-        if (vecs.size() == 0) {
-            return vecs;
+    template<class T>
+    auto is_nan_vector(const vector<T>& v)
+        -> bool
+    {
+        for (auto& e : v) {
+            if (!std::isnan(e)) {
+                return false;
+            }
         }
+        return true;
+    }
 
-        // Remove all vectors that contain only NaNs
-        vecs.erase(util::remove_if(vecs, [&](auto& v) {
-            for (auto& e : v) {
-                if (!std::isnan(e)) {
-                    return false;
-                }
+    // Calls f with the ldnn::vector<T> of every line of the given
+    // std::istream as soon as it is parsed, so that the data doesn't have
+    // to be held as a whole. Lines that contain only NaNs are skipped.
+    template<class T, class F>
+    void for_each_csv_row(std::istream& i, char delimiter, F&& f)
+    {
+        auto rank = rank_t{0};
+        for (auto line = std::string{}; std::getline(i, line); ) {
+            auto vec = parse_csv_line<T>(line, delimiter);
+            if (is_nan_vector(vec)) {
+                continue;
             }
-            return true;
-        }), end(vecs));
-
-        // Ensure that all read vectors have the same rank
-        auto rank = vecs[0].rank();
-        for (auto& v : vecs) {
-            if (v.rank() != rank) {
+            // Ensure that all read vectors have the same rank
+            if (rank.value == 0) {
+                rank = vec.rank();
+            } else if (vec.rank() != rank) {
                 throw std::invalid_argument{
                     "the data contains vectors of different lengths"};
             }
+            f(std::move(vec));
         }
+    }
 
+    // Returns a range of ldnn::vector<T> created from the lines of the
+    // given std::istream
+    template<class T>
+    auto read_csv_data(std::istream& i, char delimiter)
+    {
+        auto vecs = std::vector<vector<T>>{};
+        for_each_csv_row<T>(i, delimiter,
+            [&](vector<T>&& vec) { vecs.push_back(std::move(vec)); });
         return vecs;
     }
 
@@ -78,4 +101,141 @@ namespace ldnn {
         return result;
     }
 
+    // Feature vectors and their labels, stored separately so that several
+    // networks can read the same features with different label views.
+    template<class T>
+    struct dataset {
+        std::vector<vector<T>> features;
+        std::vector<T> labels;
+    };
+
+    template<class T>
+    auto dimension_to_dataset(
+        const std::vector<vector<T>>& data, size_t dimension)
+        -> dataset<T>
+    {
+        auto result = dataset<T>{};
+        for (auto& vec : data) {
+            result.features.push_back(remove_dimension(vec, dimension));
+            result.labels.push_back(vec[dimension]);
+        }
+        return result;
+    }
+
+    // Sparse feature vectors and their labels.
+    template<class T>
+    struct sparse_dataset {
+        sparse_matrix<T> features;
+        std::vector<T> labels;
+    };
+
+    // Reads data in the libsvm format, one example per line:
+    //     <label> <index>:<value> <index>:<value> ... # comment
+    // Indices start at 1 and are stored 0-based. Omitted entries are 0.
+    template<class T>
+    auto read_libsvm_data(std::istream& i)
+        -> sparse_dataset<T>
+    {
+        auto result = sparse_dataset<T>{};
+        auto entries = std::vector<std::pair<uint32_t, T>>{};
+        auto line_number = size_t{0};
+        for (auto line = std::string{}; std::getline(i, line); ) {
+            line_number++;
+            auto error = [&] {
+                return std::invalid_argument{"invalid libsvm data in line "
+                    + std::to_string(line_number)};
+            };
+            line.erase(std::min(line.find('#'), line.size()));
+
+            auto pos = line.c_str();
+            char* next = nullptr;
+            auto label = std::strtod(pos, &next);
+            if (next == pos) {
+                // Skip empty lines.
+                if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                    continue;
+                }
+                throw error();
+            }
+            pos = next;
+
+            entries.clear();
+            while (true) {
+                while (*pos == ' ' || *pos == '\t' || *pos == '\r') {
+                    pos++;
+                }
+                if (*pos == '\0') {
+                    break;
+                }
+                auto index = std::strtoul(pos, &next, 10);
+                if (next == pos || *next != ':' || index == 0
+                    || index > std::numeric_limits<uint32_t>::max()) {
+                    throw error();
+                }
+                pos = next + 1;
+                errno = 0;
+                auto value = std::strtod(pos, &next);
+                if (next == pos || errno == ERANGE) {
+                    throw error();
+                }
+                pos = next;
+                entries.emplace_back(static_cast<uint32_t>(index - 1),
+                    static_cast<T>(value));
+            }
+            result.features.push_back(entries);
+            result.labels.push_back(static_cast<T>(label));
+        }
+        return result;
+    }
+
+    template<class T>
+    auto read_libsvm_file(const std::string& filename)
+        -> sparse_dataset<T>
+    {
+        auto file = std::ifstream(filename);
+        if (!file.is_open()) {
+            throw std::invalid_argument{"File couldn't be opened!"};
+        }
+        return read_libsvm_data<T>(file);
+    }
+
+    // Per-dimension minimum and maximum of a set of vectors. The statistics
+    // can be updated incrementally, e.g. while the data is still being read.
+    template<class T>
+    class column_stats {
+    public:
+        void update(const vector<T>& vec) {
+            if (min.size() == 0) {
+                min.assign(vec.begin(), vec.end());
+                max.assign(vec.begin(), vec.end());
+                return;
+            }
+            if (vec.rank().value != min.size()) {
+                throw std::invalid_argument{"rank differs"};
+            }
+            for (auto i : indices(min.size())) {
+                min[i] = std::min(min[i], vec[i]);
+                max[i] = std::max(max[i], vec[i]);
+            }
+        }
+
+        // Maps every dimension of vec to [0, 1]. Dimensions that have been
+        // constant so far are mapped to 0.
+        template<class A>
+        void normalize(vector<T, A>& vec) const {
+            for (auto i : indices(min.size())) {
+                vec[i] -= min[i];
+                if (max[i] > min[i]) {
+                    vec[i] /= max[i] - min[i];
+                } else {
+                    vec[i] = T{0};
+                }
+            }
+        }
+
+    private:
+        std::vector<T> min;
+        std::vector<T> max;
+    };
+
 } // namespace ldnn
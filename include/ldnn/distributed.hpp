@@ -0,0 +1,360 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "network.hpp"
+
+namespace ldnn {
+
+    // Parses a list of peer addresses of the form [address,address,...].
+    inline auto parse_peers(const std::string& str)
+        -> std::vector<std::string>
+    {
+        auto result = std::vector<std::string>{};
+        auto lnstr = std::stringstream{str};
+        for (auto word = std::string{}; std::getline(lnstr, word, ','); ) {
+            word.erase(std::remove_if(begin(word), end(word), [](char c) {
+                return c == '[' || c == ']' || std::isspace(c);
+            }), end(word));
+            if (word.size() > 0) {
+                result.push_back(word);
+            }
+        }
+        return result;
+    }
+
+// Connects the processes of a distributed training run in a ring. Every
+// process listens on its own address, sends to the next and receives from
+// the previous process. Addresses are either unix:<path> or <host>:<port>.
+class ring_communicator {
+public:
+    ring_communicator(size_t rank, std::vector<std::string> peers,
+        std::chrono::seconds timeout = std::chrono::seconds{60})
+        : rank_(rank), peers(std::move(peers))
+    {
+        if (rank_ >= this->peers.size()) {
+            throw std::invalid_argument{"rank out of range"};
+        }
+        if (size() == 1) {
+            return;
+        }
+
+        listen_fd = listen(this->peers[rank_]);
+        next_fd = connect(this->peers[(rank_ + 1) % size()], timeout);
+        prev_fd = ::accept(listen_fd, nullptr, nullptr);
+        if (prev_fd < 0) {
+            throw_error("accept");
+        }
+
+        // The ring is complete, so the address can be reused right away.
+        ::close(listen_fd);
+        listen_fd = -1;
+        if (is_unix(this->peers[rank_])) {
+            ::unlink(this->peers[rank_].substr(5).c_str());
+        }
+        for (auto fd : {next_fd, prev_fd}) {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+    }
+
+    ring_communicator(const ring_communicator&) = delete;
+    ring_communicator& operator=(const ring_communicator&) = delete;
+
+    ~ring_communicator() {
+        for (auto fd : {next_fd, prev_fd, listen_fd}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    auto rank() const
+        -> size_t
+    {
+        return rank_;
+    }
+
+    auto size() const
+        -> size_t
+    {
+        return peers.size();
+    }
+
+    // Replaces data by the element-wise sum over all processes, using the
+    // ring algorithm: a reduce-scatter followed by an all-gather, so that
+    // every process sends and receives 2 * (size - 1) / size * data.size()
+    // elements.
+    template<class T>
+    void all_reduce_sum(std::vector<T>& data) {
+        auto n = size();
+        if (n == 1) {
+            return;
+        }
+
+        auto chunk_begin = [&](size_t c) { return c * data.size() / n; };
+        auto chunk_size = [&](size_t c) {
+            return chunk_begin(c + 1) - chunk_begin(c);
+        };
+        auto buffer = std::vector<T>(chunk_size(0) + 1);
+
+        for (size_t step = 0; step + 1 < n; ++step) {
+            auto send = (rank_ + n - step) % n;
+            auto recv = (rank_ + n - step - 1) % n;
+            exchange(data.data() + chunk_begin(send),
+                chunk_size(send) * sizeof(T),
+                buffer.data(), chunk_size(recv) * sizeof(T));
+            for (auto i : indices(chunk_size(recv))) {
+                data[chunk_begin(recv) + i] += buffer[i];
+            }
+        }
+        for (size_t step = 0; step + 1 < n; ++step) {
+            auto send = (rank_ + 1 + n - step) % n;
+            auto recv = (rank_ + n - step) % n;
+            exchange(data.data() + chunk_begin(send),
+                chunk_size(send) * sizeof(T),
+                data.data() + chunk_begin(recv), chunk_size(recv) * sizeof(T));
+        }
+    }
+
+    // Replaces data by the element-wise mean over all processes.
+    template<class T>
+    void all_reduce_mean(std::vector<T>& data) {
+        all_reduce_sum(data);
+        for (auto& e : data) {
+            e /= static_cast<T>(size());
+        }
+    }
+
+    // Replaces value by the value of rank 0.
+    template<class T>
+    void broadcast(T& value) {
+        if (size() == 1) {
+            return;
+        }
+        if (rank_ != 0) {
+            exchange(nullptr, 0, &value, sizeof(T));
+        }
+        if (rank_ + 1 != size()) {
+            exchange(&value, sizeof(T), nullptr, 0);
+        }
+    }
+
+private:
+    static auto is_unix(const std::string& address)
+        -> bool
+    {
+        return address.compare(0, 5, "unix:") == 0;
+    }
+
+    [[noreturn]] static void throw_error(const std::string& what) {
+        throw std::runtime_error{what + ": " + std::strerror(errno)};
+    }
+
+    // Calls fn(family, address, length) with the resolved socket address.
+    template<class Fn>
+    static auto with_address(const std::string& address, Fn&& fn) {
+        if (is_unix(address)) {
+            auto addr = sockaddr_un{};
+            addr.sun_family = AF_UNIX;
+            auto path = address.substr(5);
+            if (path.size() >= sizeof(addr.sun_path)) {
+                throw std::invalid_argument{"socket path too long: " + path};
+            }
+            std::strcpy(addr.sun_path, path.c_str());
+            return fn(AF_UNIX, reinterpret_cast<sockaddr*>(&addr),
+                static_cast<socklen_t>(sizeof(addr)));
+        }
+
+        auto colon = address.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::invalid_argument{"invalid address: " + address};
+        }
+        auto hints = addrinfo{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* info = nullptr;
+        if (::getaddrinfo(address.substr(0, colon).c_str(),
+            address.substr(colon + 1).c_str(), &hints, &info) != 0) {
+            throw std::invalid_argument{"couldn't resolve " + address};
+        }
+        try {
+            auto result = fn(info->ai_family, info->ai_addr, info->ai_addrlen);
+            ::freeaddrinfo(info);
+            return result;
+        } catch (...) {
+            ::freeaddrinfo(info);
+            throw;
+        }
+    }
+
+    static auto listen(const std::string& address)
+        -> int
+    {
+        return with_address(address, [&](int family, sockaddr* addr,
+            socklen_t length) {
+            auto fd = ::socket(family, SOCK_STREAM, 0);
+            if (fd < 0) {
+                throw_error("socket");
+            }
+            if (family == AF_UNIX) {
+                ::unlink(address.substr(5).c_str());
+            } else {
+                auto one = 1;
+                ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            }
+            if (::bind(fd, addr, length) < 0 || ::listen(fd, 1) < 0) {
+                ::close(fd);
+                throw_error("couldn't listen on " + address);
+            }
+            return fd;
+        });
+    }
+
+    // Connects to address, retrying until the peer listens or the timeout
+    // expires.
+    static auto connect(const std::string& address,
+        std::chrono::seconds timeout)
+        -> int
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        return with_address(address, [&](int family, sockaddr* addr,
+            socklen_t length) {
+            while (true) {
+                auto fd = ::socket(family, SOCK_STREAM, 0);
+                if (fd < 0) {
+                    throw_error("socket");
+                }
+                if (::connect(fd, addr, length) == 0) {
+                    return fd;
+                }
+                ::close(fd);
+                if (std::chrono::steady_clock::now() > deadline) {
+                    throw_error("couldn't connect to " + address);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds{100});
+            }
+        });
+    }
+
+    // Sends send_size bytes to the next and receives recv_size bytes from
+    // the previous process at the same time, so that neither side blocks
+    // on a full socket buffer.
+    void exchange(const void* send, size_t send_size,
+        void* recv, size_t recv_size)
+    {
+        auto send_ptr = static_cast<const char*>(send);
+        auto recv_ptr = static_cast<char*>(recv);
+        while (send_size > 0 || recv_size > 0) {
+            pollfd fds[2] = {
+                {next_fd, static_cast<short>(send_size > 0 ? POLLOUT : 0), 0},
+                {prev_fd, static_cast<short>(recv_size > 0 ? POLLIN : 0), 0}
+            };
+            if (::poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw_error("poll");
+            }
+            // POLLERR and POLLHUP are reported even for sockets that are not
+            // waited on, e.g. once the next process has finished.
+            if (send_size > 0
+                && fds[0].revents & (POLLOUT | POLLERR | POLLHUP)) {
+                auto n = ::send(next_fd, send_ptr, send_size, MSG_NOSIGNAL);
+                if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                    throw_error("send");
+                }
+                if (n > 0) {
+                    send_ptr += n;
+                    send_size -= static_cast<size_t>(n);
+                }
+            }
+            if (recv_size > 0
+                && fds[1].revents & (POLLIN | POLLERR | POLLHUP)) {
+                auto n = ::recv(prev_fd, recv_ptr, recv_size, 0);
+                if (n == 0) {
+                    throw std::runtime_error{"peer closed the connection"};
+                }
+                if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                    throw_error("recv");
+                }
+                if (n > 0) {
+                    recv_ptr += n;
+                    recv_size -= static_cast<size_t>(n);
+                }
+            }
+        }
+    }
+
+private:
+    size_t rank_;
+    std::vector<std::string> peers;
+    int listen_fd = -1;
+    int next_fd = -1;
+    int prev_fd = -1;
+};
+
+// Performs one epoch of data-parallel training: every process trains its
+// replica on its own shard of examples and the parameters of all replicas
+// are averaged every sync_interval steps and at the end of the epoch. The
+// shards differ in size by at most one example, all processes step through
+// the size of the largest one so that they average at the same steps.
+// examples has to be in the same order on all processes. Calls
+// observe(1, squared_error) after every local example.
+template<class T, class Observer>
+void distributed_epoch(network<T>& net,
+    const std::vector<typename network<T>::classification>& examples,
+    ring_communicator& comm, size_t sync_interval, Observer&& observe)
+{
+    auto shard_begin = [&](size_t rank) {
+        return rank * examples.size() / comm.size();
+    };
+    auto first = begin(examples)
+        + static_cast<std::ptrdiff_t>(shard_begin(comm.rank()));
+    auto shard_size = shard_begin(comm.rank() + 1) - shard_begin(comm.rank());
+    auto steps = (examples.size() + comm.size() - 1) / comm.size();
+    auto sync = [&] {
+        auto parameters = net.parameters();
+        comm.all_reduce_mean(parameters);
+        net.set_parameters(parameters);
+    };
+    for (auto step : indices(steps)) {
+        if (step < shard_size) {
+            observe(size_t{1},
+                util::square(net.gradient_descent(*(first + step))));
+        }
+        if (sync_interval > 0 && (step + 1) % sync_interval == 0) {
+            sync();
+        }
+    }
+    if (sync_interval == 0 || steps % sync_interval != 0) {
+        sync();
+    }
+    net.next_epoch();
+}
+
+template<class T>
+void distributed_epoch(network<T>& net,
+    const std::vector<typename network<T>::classification>& examples,
+    ring_communicator& comm, size_t sync_interval)
+{
+    distributed_epoch(net, examples, comm, sync_interval, [](size_t, T) {});
+}
+
+} // namespace ldnn
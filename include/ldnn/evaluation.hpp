@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "util/execution.hpp"
+#include "util/indices.hpp"
+
+namespace ldnn {
+
+    // Metrics of a binary classifier on labeled examples. An example is
+    // classified as positive if its score is above 0.5.
+    template<class T = double>
+    struct evaluation {
+        size_t true_positives = 0;
+        size_t false_positives = 0;
+        size_t true_negatives = 0;
+        size_t false_negatives = 0;
+
+        // Sum of the negative log-likelihoods of the labels, with scores
+        // clamped to [1e-15, 1 - 1e-15].
+        T log_loss_sum = T{0};
+
+        // Sum of the squared differences of scores and labels, the value of
+        // network::quadratic_error.
+        T quadratic_error = T{0};
+
+        // Area under the ROC curve, the probability that a random positive
+        // example scores higher than a random negative one, with ties
+        // counted as 1/2. NaN if there are no positive or negative examples.
+        T auc = std::numeric_limits<T>::quiet_NaN();
+
+        auto size() const
+            -> size_t
+        {
+            return true_positives + false_positives
+                + true_negatives + false_negatives;
+        }
+
+        auto accuracy() const
+            -> T
+        {
+            return static_cast<T>(true_positives + true_negatives)
+                / std::max<size_t>(size(), 1);
+        }
+
+        // Mean negative log-likelihood.
+        auto log_loss() const
+            -> T
+        {
+            return log_loss_sum / std::max<size_t>(size(), 1);
+        }
+
+        // Adds the counts and sums of other, but not the auc.
+        auto operator+=(const evaluation& other)
+            -> evaluation&
+        {
+            true_positives += other.true_positives;
+            false_positives += other.false_positives;
+            true_negatives += other.true_negatives;
+            false_negatives += other.false_negatives;
+            log_loss_sum += other.log_loss_sum;
+            quadratic_error += other.quadratic_error;
+            return *this;
+        }
+
+        void add(T score, bool positive) {
+            if (score > T{0.5}) {
+                (positive ? true_positives : false_positives)++;
+            } else {
+                (positive ? false_negatives : true_negatives)++;
+            }
+            constexpr auto epsilon = T{1e-15};
+            auto p = std::min(std::max(score, epsilon), T{1} - epsilon);
+            log_loss_sum -= std::log(positive ? p : T{1} - p);
+            quadratic_error += util::square(score - (positive ? T{1} : T{0}));
+        }
+    };
+
+    // Returns the auc of (score, positive) pairs, which are sorted by score.
+    // Tied scores get the mean of their ranks (Mann-Whitney U).
+    template<class T>
+    auto roc_auc(std::vector<std::pair<T, bool>>& scores)
+        -> T
+    {
+        std::sort(begin(scores), end(scores),
+            [](auto& l, auto& r) { return l.first < r.first; });
+
+        auto positives = size_t{0};
+        auto rank_sum = T{0};
+        for (size_t first = 0; first < scores.size(); ) {
+            auto last = first;
+            auto group_positives = size_t{0};
+            while (last < scores.size()
+                && scores[last].first == scores[first].first) {
+                group_positives += scores[last].second ? 1 : 0;
+                last++;
+            }
+            // ranks first + 1 to last
+            rank_sum += group_positives * (first + 1 + last) / T{2};
+            positives += group_positives;
+            first = last;
+        }
+
+        auto negatives = scores.size() - positives;
+        if (positives == 0 || negatives == 0) {
+            return std::numeric_limits<T>::quiet_NaN();
+        }
+        return (rank_sum - positives * (positives + T{1}) / T{2})
+            / (static_cast<T>(positives) * negatives);
+    }
+
+    // Scores the classifications in examples with model.classify_batch in
+    // parallel chunks and computes all metrics in the same pass. Only the
+    // auc needs a sort of all scores afterwards.
+    template<class Model, class Range>
+    auto evaluate(const util::execution::parallel_policy& policy,
+        const Model& model, Range&& examples)
+    {
+        using T = typename std::decay<decltype(
+            model.classify_batch(begin(examples), begin(examples)))>
+            ::type::value_type;
+
+        auto first = begin(examples);
+        auto n = util::size(examples);
+        auto scores = std::vector<std::pair<T, bool>>(n);
+        auto partials = util::detail::parallel_chunks(policy, n,
+            [&](size_t l, size_t r) {
+                auto result = evaluation<T>{};
+                auto chunk = model.classify_batch(first + l, first + r);
+                for (auto i : indices(r - l)) {
+                    auto positive = (first + l + i)->positive;
+                    result.add(chunk[i], positive);
+                    scores[l + i] = {chunk[i], positive};
+                }
+                return result;
+            });
+
+        auto result = evaluation<T>{};
+        for (auto& partial : partials) {
+            result += partial;
+        }
+        result.auc = roc_auc(scores);
+        return result;
+    }
+
+    template<class Model, class Range>
+    auto evaluate(const Model& model, Range&& examples) {
+        return evaluate(util::execution::par, model,
+            std::forward<Range>(examples));
+    }
+
+} // namespace ldnn
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cmath>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include "network.hpp"
+
+// The polytope and halfspace counts that have specialized kernels. Every pair
+// (P, H) of these values is instantiated.
+#define LDNN_FIXED_SIZES 1, 2, 3, 4, 6, 8
+
+namespace ldnn {
+
+    namespace detail {
+
+        template<class T>
+        using fixed_kernel_t = T (*)(const T*, const T*, const T*, size_t);
+
+        // Evaluates a network of P polytopes with H halfspaces each. The
+        // weights are stored transposed, weight[k * P * H + h] is dimension
+        // k of halfspace h, so that the P * H accumulators of one dimension
+        // are updated with contiguous loads and stay in registers. All loop
+        // bounds but the rank are constants and the loops are unrolled.
+        template<class T, size_t P, size_t H>
+        auto fixed_kernel(const T* weight, const T* bias, const T* x,
+            size_t rank)
+            -> T
+        {
+            constexpr auto N = P * H;
+            T z[N];
+            for (size_t h = 0; h < N; ++h) {
+                z[h] = bias[h];
+            }
+            for (size_t k = 0; k < rank; ++k) {
+                auto xk = x[k];
+                auto w = weight + k * N;
+                for (size_t h = 0; h < N; ++h) {
+                    z[h] += w[h] * xk;
+                }
+            }
+
+            auto result = T{1};
+            for (size_t i = 0; i < P; ++i) {
+                auto product = T{1};
+                for (size_t j = 0; j < H; ++j) {
+                    product /= T{1} + std::exp(-z[i * H + j]);
+                }
+                result *= T{1} - product;
+            }
+            return T{1} - result;
+        }
+
+        template<class T, size_t P, size_t... Hs>
+        auto find_fixed_kernel(size_t h)
+            -> fixed_kernel_t<T>
+        {
+            auto kernel = fixed_kernel_t<T>{nullptr};
+            (void)std::initializer_list<int>{
+                (h == Hs ? (kernel = &fixed_kernel<T, P, Hs>, 0) : 0)...};
+            return kernel;
+        }
+
+        template<class T, size_t... Ps>
+        auto find_fixed_kernel(size_t p, size_t h)
+            -> fixed_kernel_t<T>
+        {
+            auto kernel = fixed_kernel_t<T>{nullptr};
+            (void)std::initializer_list<int>{
+                (p == Ps ? (kernel = find_fixed_kernel<T, Ps,
+                    LDNN_FIXED_SIZES>(h), 0) : 0)...};
+            return kernel;
+        }
+
+    } // namespace detail
+
+// Classifies with a kernel that is specialized for the polytope and
+// halfspace counts of the network if there is one, and with the network
+// itself otherwise, e.g. after pruning left polytopes of different sizes.
+// The specialized kernels always evaluate all halfspaces, so they ignore
+// inference_epsilon.
+template<class T = double>
+class compiled_network {
+public:
+    explicit compiled_network(network<T> net)
+        : net(std::move(net))
+    {
+        auto& weights = this->net.weights();
+        auto& biases = this->net.biases();
+        if (weights.size() == 0) {
+            return;
+        }
+        auto halfspaces = weights[0].size();
+        for (auto& polytope : weights) {
+            if (polytope.size() != halfspaces) {
+                return;
+            }
+        }
+        kernel = detail::find_fixed_kernel<T, LDNN_FIXED_SIZES>(
+            weights.size(), halfspaces);
+        if (!kernel) {
+            return;
+        }
+
+        rank = weights[0][0].rank().value;
+        auto n = weights.size() * halfspaces;
+        weight.resize(rank * n);
+        for (auto i : indices(weights.size())) {
+            for (auto j : indices(halfspaces)) {
+                auto h = i * halfspaces + j;
+                for (auto k : indices(rank)) {
+                    weight[k * n + h] = weights[i][j][k];
+                }
+                bias.push_back(biases[i][j]);
+            }
+        }
+    }
+
+    auto classify(const vector<T>& v) const
+        -> T
+    {
+        if (!kernel) {
+            return net.classify(v);
+        }
+        if (v.rank().value != rank) {
+            throw std::invalid_argument{"rank differs"};
+        }
+        return kernel(weight.data(), bias.data(), &*v.begin(), rank);
+    }
+
+    // Returns the outputs for the classifications [first, last).
+    template<class It>
+    auto classify_batch(It first, It last) const
+        -> std::vector<T>
+    {
+        if (!kernel) {
+            return net.classify_batch(first, last);
+        }
+        auto result = std::vector<T>{};
+        result.reserve(static_cast<size_t>(std::distance(first, last)));
+        for (; first != last; ++first) {
+            result.push_back(classify(first->vec));
+        }
+        return result;
+    }
+
+    // Whether a specialized kernel is used.
+    auto specialized() const
+        -> bool
+    {
+        return kernel != nullptr;
+    }
+
+private:
+    network<T> net;
+    detail::fixed_kernel_t<T> kernel = nullptr;
+    size_t rank = 0;
+    std::vector<T> weight;
+    std::vector<T> bias;
+};
+
+} // namespace ldnn
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <future>
+#include <vector>
+
+#include "util/random.hpp"
+#include "util/thread_pool.hpp"
+
+#include "data.hpp"
+#include "network.hpp"
+
+namespace ldnn {
+
+// A multi-class classifier that consists of one binary network per class,
+// each trained to separate its class from all others. All networks share
+// the feature storage of one dataset and only differ in their label view.
+template<class T = double>
+class one_vs_rest {
+public:
+    // Trains one network per distinct label of the examples data[i], i in
+    // selection, for the given number of epochs. The networks are trained
+    // in parallel on pool, the network of the c-th class with the random
+    // stream c of rng.
+    one_vs_rest(typename network<T>::config_t config, const dataset<T>& data,
+        const std::vector<size_t>& selection, size_t epochs,
+        util::thread_pool& pool, const util::philox4x32& rng)
+    {
+        for (auto i : selection) {
+            labels.push_back(data.labels[i]);
+        }
+        std::sort(begin(labels), end(labels));
+        labels.erase(std::unique(begin(labels), end(labels)), end(labels));
+
+        auto results = std::vector<std::future<network<T>>>{};
+        for (auto c : indices(labels.size())) {
+            results.push_back(pool.submit([&, c] {
+                auto label = labels[c];
+                auto class_gen = rng.stream(c);
+                auto is_positive = [&](size_t i) {
+                    return data.labels[i] == label;
+                };
+                auto net = network<T>{
+                    config, data.features, selection, is_positive, class_gen};
+                auto order = selection;
+                for (auto remaining = epochs; remaining-- > 0; ) {
+                    util::shuffle(order, class_gen);
+                    for (auto i : order) {
+                        net.gradient_descent(data.features[i], is_positive(i));
+                    }
+                    net.next_epoch();
+                }
+                return net;
+            }));
+        }
+        // The tasks refer to the arguments and labels, so wait for all of
+        // them before the first error may leave this scope.
+        for (auto& result : results) {
+            result.wait();
+        }
+        for (auto& result : results) {
+            networks.push_back(result.get());
+        }
+    }
+
+    // Returns the distinct labels, in the order of the scores returned by
+    // classify.
+    auto classes() const
+        -> const std::vector<T>&
+    {
+        return labels;
+    }
+
+    // Evaluates all class networks on v in one pass.
+    auto classify(const vector<T>& v) const
+        -> std::vector<T>
+    {
+        auto scores = std::vector<T>{};
+        scores.reserve(networks.size());
+        for (auto& net : networks) {
+            scores.push_back(net.classify(v));
+        }
+        return scores;
+    }
+
+    // Returns the label of the class with the highest score.
+    auto predict(const vector<T>& v) const
+        -> T
+    {
+        auto scores = classify(v);
+        return labels[util::index(scores, std::max_element(
+            begin(scores), end(scores)))];
+    }
+
+private:
+    std::vector<T> labels;
+    std::vector<network<T>> networks;
+};
+
+} // namespace ldnn
@@ -1,11 +1,29 @@
 #pragma once
 
+#include <atomic>
+#include <limits>
+#include <numeric>
 #include <type_traits>
 
+#include "util/execution.hpp"
+#include "util/gemm.hpp"
+
+#include "ldnn/compact_vector.hpp"
+#include "ldnn/optimizer.hpp"
+#include "ldnn/sparse_vector.hpp"
 #include "ldnn/vector.hpp"
 
 namespace ldnn {
 
+    // Number of halfspace evaluations of all networks whose exponential
+    // overflowed, which evaluate to 0.
+    inline auto saturated_halfspaces()
+        -> std::atomic<size_t>&
+    {
+        static std::atomic<size_t> count{0};
+        return count;
+    }
+
 template<class T = double>
 class network {
     static_assert(std::is_floating_point<T>::value,
@@ -19,11 +37,24 @@ public:
         // Maximum number of halfspaces per polytope.
         size_t max_halfspaces;
 
-        // Alpha parameter of the network.
+        // Alpha parameter of the network, the (initial) learning rate.
         T alpha;
 
+        // The optimizer used to apply the gradients.
+        typename optimizer<T>::config_t optimizer;
+
         // Number of iterations for the kmeans algorithm.
         size_t kmeans_iterations;
+
+        // Products of sigmoids below this value are treated as zero during
+        // inference, so the remaining factors don't have to be evaluated.
+        // A value of 0 disables the early exit.
+        T inference_epsilon;
+
+        // Number of examples whose mean gradient is applied in one step by
+        // the range overload of gradient_descent. Values above 1 use the
+        // batched passes, 0 and 1 apply the examples one by one.
+        size_t batch_size;
     };
 
     struct classification {
@@ -42,13 +73,20 @@ public:
             ini_config.GetInteger("network", "max_halfspaces", 0);
         config.alpha =
             ini_config.GetReal("network", "alpha", 0.0);
+        config.optimizer = optimizer<T>::read_config(ini_config);
         config.kmeans_iterations =
             ini_config.GetInteger("network", "kmeans_iterations", 0);
+        config.inference_epsilon =
+            ini_config.GetReal("network", "inference_epsilon", 0.0);
+        config.batch_size =
+            ini_config.GetInteger("network", "batch_size", 1);
 
         return config;
     }
 
 public:
+    // The examples are only referred to by their index during the
+    // initialization, they are never copied.
     template<class URBG>
     network(config_t config, const std::vector<classification>& examples, URBG&& gen)
         : config(config)
@@ -56,74 +94,264 @@ public:
         if (examples.size() == 0)
             throw std::invalid_argument("examples.size() == 0");
 
-        // Check that all input data has the same rank.
-        auto rank = examples[0].vec.rank();
-        for (auto& c : examples) {
-            if (c.vec.rank() != rank) {
-                throw std::invalid_argument(
-                    "all examples must have the same rank");
-            }
+        auto pos_rows = std::vector<size_t>{};
+        auto neg_rows = std::vector<size_t>{};
+        for (auto i : indices(examples.size())) {
+            (examples[i].positive ? pos_rows : neg_rows).push_back(i);
         }
+        initialize([&](size_t i) -> const vector<T>& {
+            return examples[i].vec;
+        }, std::move(pos_rows), std::move(neg_rows), gen);
+    }
 
-        // Allocate memory.
-        weight.resize(config.polytope_count);
-        bias.resize(config.polytope_count);
-        for (auto i : indices(config.polytope_count)) {
-            weight[i].resize(config.max_halfspaces, vector<T>(rank));
-            bias[i].resize(config.max_halfspaces);
-        }
+    // Creates a network for the examples features[i] for every index i in
+    // selection. is_positive(i) returns the classification of features[i],
+    // so that several networks can share the same feature storage.
+    template<class Predicate, class URBG>
+    network(config_t config, const std::vector<vector<T>>& features,
+        const std::vector<size_t>& selection, Predicate&& is_positive,
+        URBG&& gen)
+        : config(config)
+    {
+        if (selection.size() == 0)
+            throw std::invalid_argument("selection.size() == 0");
 
-        // Initialize the network.
-        auto pos_examples = std::vector<vector<T>>{};
-        auto neg_examples = std::vector<vector<T>>{};
-        util::for_each(examples, [&](auto& c) {
-            if (c.positive) {
-                pos_examples.push_back(c.vec);
-            } else {
-                neg_examples.push_back(c.vec);
-            }
+        auto pos_rows = std::vector<size_t>{};
+        auto neg_rows = std::vector<size_t>{};
+        util::for_each(selection, [&](auto i) {
+            (is_positive(i) ? pos_rows : neg_rows).push_back(i);
         });
-        auto pos_ctrds = kmeans(pos_examples,
-            config.polytope_count, gen, config.kmeans_iterations);
-        auto neg_ctrds = kmeans(neg_examples,
-            config.max_halfspaces, gen, config.kmeans_iterations);
-        for (auto i : indices(pos_ctrds.size())) {
-            for (auto j : indices(neg_ctrds.size())) {
-                weight[i][j] = normalize(pos_ctrds[i] - neg_ctrds[j]);
-                bias[i][j] = weight[i][j] * (0.5 * (pos_ctrds[i] + neg_ctrds[j]));
-            }
-        }
+        initialize([&](size_t i) -> const vector<T>& {
+            return features[i];
+        }, std::move(pos_rows), std::move(neg_rows), gen);
+    }
+
+    // Creates a network for the sparse examples features[i] for every index
+    // i in selection, see above.
+    template<class Predicate, class URBG>
+    network(config_t config, const sparse_matrix<T>& features,
+        const std::vector<size_t>& selection, Predicate&& is_positive,
+        URBG&& gen)
+        : config(config)
+    {
+        initialize_matrix(features, selection, is_positive, gen);
+    }
+
+    // Creates a network for the compact examples features[i] for every
+    // index i in selection, see above.
+    template<class E, class Rows, class Predicate, class URBG>
+    network(config_t config, const compact_matrix<E, Rows>& features,
+        const std::vector<size_t>& selection, Predicate&& is_positive,
+        URBG&& gen)
+        : config(config)
+    {
+        initialize_matrix(features, selection, is_positive, gen);
+    }
+
+    // Creates a network from the centroids of the positive and negative
+    // examples, e.g. as computed by kmeans.
+    network(config_t config, const std::vector<vector<T>>& pos_centroids,
+        const std::vector<vector<T>>& neg_centroids)
+        : config(config)
+    {
+        initialize(pos_centroids, neg_centroids);
+    }
+
+    // Returns k centroids of the vectors data[i], i in rows, computed by the
+    // given number of iterations of Lloyd's algorithm after a random
+    // initialization. Only the indices are shuffled, data isn't copied.
+    template<class URBG>
+    static auto kmeans(const std::vector<vector<T>>& data,
+        std::vector<size_t> rows, size_t k, URBG&& gen, size_t iterations = 10)
+        -> std::vector<vector<T>>
+    {
+        return kmeans_rows([&](size_t i) -> const vector<T>& {
+            return data[i];
+        }, std::move(rows), k, gen, iterations);
     }
 
-    auto classify(const vector<T>& v)
+    // Returns k centroids of the vectors of examples[i], i in rows.
+    template<class URBG>
+    static auto kmeans(const std::vector<classification>& examples,
+        std::vector<size_t> rows, size_t k, URBG&& gen, size_t iterations = 10)
+        -> std::vector<vector<T>>
+    {
+        return kmeans_rows([&](size_t i) -> const vector<T>& {
+            return examples[i].vec;
+        }, std::move(rows), k, gen, iterations);
+    }
+
+    // Returns k centroids of all vectors of data.
+    template<class URBG>
+    static auto kmeans(const std::vector<vector<T>>& data,
+        size_t k, URBG&& gen, size_t iterations = 10)
+        -> std::vector<vector<T>>
+    {
+        auto rows = std::vector<size_t>(data.size());
+        std::iota(begin(rows), end(rows), size_t{0});
+        return kmeans(data, std::move(rows), k, gen, iterations);
+    }
+
+    // Returns k dense centroids of the sparse rows data[i], i in rows, see
+    // above. A distance only costs O(nnz), because the squared lengths of
+    // the centroids are computed once per iteration.
+    template<class URBG>
+    static auto kmeans(const sparse_matrix<T>& data, std::vector<size_t> rows,
+        size_t k, URBG&& gen, size_t iterations = 10)
+        -> std::vector<vector<T>>
+    {
+        return kmeans_matrix(data, std::move(rows), k, gen, iterations);
+    }
+
+    // Returns k centroids of the compact rows data[i], i in rows. The rows
+    // are decoded block by block during the distance computations.
+    template<class E, class Rows, class URBG>
+    static auto kmeans(const compact_matrix<E, Rows>& data,
+        std::vector<size_t> rows, size_t k, URBG&& gen,
+        size_t iterations = 10)
+        -> std::vector<vector<T>>
+    {
+        return kmeans_matrix(data, std::move(rows), k, gen, iterations);
+    }
+
+    // Returns the output of the network for a dense or sparse input v.
+    template<class V>
+    auto classify(const V& v) const
         -> T
     {
-        auto result = T{1};
-        for (auto i : indices(config.polytope_count)) {
-            result *= T{1} - polytope(i, v);
+        return output(v, config.inference_epsilon);
+    }
+
+    // Returns the output of the network for a compact input v, which is
+    // decoded once instead of for every halfspace.
+    template<class E>
+    auto classify(const compact_row<E>& v) const
+        -> T
+    {
+        util::arena::scope scope;
+        auto dense = scratch_vector<T>{v.rank()};
+        decode(v, dense);
+        return classify(dense);
+    }
+
+    auto get_config() const
+        -> const config_t&
+    {
+        return config;
+    }
+
+    // The weight of halfspace j of polytope i is weights()[i][j], its bias
+    // is biases()[i][j].
+    auto weights() const
+        -> const std::vector<std::vector<vector<T>>>&
+    {
+        return weight;
+    }
+
+    auto biases() const
+        -> const std::vector<std::vector<T>>&
+    {
+        return bias;
+    }
+
+    // Returns all weights and biases, halfspace by halfspace, each weight
+    // followed by its bias.
+    auto parameters() const
+        -> std::vector<T>
+    {
+        auto result = std::vector<T>{};
+        for (auto i : indices(weight.size())) {
+            for (auto j : indices(weight[i].size())) {
+                result.insert(end(result), weight[i][j].begin(),
+                    weight[i][j].end());
+                result.push_back(bias[i][j]);
+            }
         }
+        return result;
+    }
 
-        return T{1} - result;
+    // Sets all weights and biases from the layout returned by parameters.
+    void set_parameters(const std::vector<T>& parameters) {
+        auto it = begin(parameters);
+        for (auto i : indices(weight.size())) {
+            for (auto j : indices(weight[i].size())) {
+                auto rank = weight[i][j].rank().value;
+                if (static_cast<size_t>(std::distance(it, end(parameters)))
+                    < rank + 1) {
+                    throw std::invalid_argument("too few parameters");
+                }
+                std::copy(it, it + rank, weight[i][j].begin());
+                it += rank;
+                bias[i][j] = *it++;
+            }
+        }
+        if (it != end(parameters)) {
+            throw std::invalid_argument("too many parameters");
+        }
     }
 
-    void gradient_descent(const classification& c) {
-        for (auto i : indices(config.polytope_count)) {
-            for (auto j : indices(config.max_halfspaces)) {
-                auto diff = T{2} * error(c);
+    auto optimizer_state() const
+        -> typename optimizer<T>::state_t
+    {
+        return optim.state();
+    }
 
-                for (auto r : indices(config.polytope_count)) {
+    void set_optimizer_state(typename optimizer<T>::state_t state) {
+        optim.set_state(std::move(state));
+    }
+
+    // Applies the gradient of the error on a dense or sparse input v,
+    // scaled by sample_weight. For sparse inputs, this costs O(nnz) per
+    // halfspace instead of O(rank). Returns the error of the output before
+    // the update.
+    template<class V>
+    auto gradient_descent(const V& v, bool positive, T sample_weight = T{1})
+        -> T
+    {
+        optim.next_step();
+        auto initial_error = T{0};
+        auto measured = false;
+        for (auto i : indices(weight.size())) {
+            for (auto j : indices(weight[i].size())) {
+                auto e = error(v, positive);
+                if (!measured) {
+                    initial_error = e;
+                    measured = true;
+                }
+                auto diff = T{2} * e * sample_weight;
+
+                for (auto r : indices(weight.size())) {
                     if (i != r) {
-                        diff *= (T{1} - polytope(r, c.vec));
+                        diff *= (T{1} - polytope(r, v));
                     }
                 }
 
-                diff *= polytope(i, c.vec) * (T{1} - halfspace(i, j, c.vec));
-                diff *= config.alpha;
+                diff *= polytope(i, v) * (T{1} - halfspace(i, j, v));
 
-                weight[i][j] = weight[i][j] - (diff * c.vec);
-                bias[i][j] -= diff;
+                optim.update(parameter_offset(i, j),
+                    weight[i][j], bias[i][j], diff, v);
             };
         }
+        return initial_error;
+    }
+
+    // Applies the gradient of the error on a compact input v, which is
+    // decoded once instead of for every halfspace.
+    template<class E>
+    auto gradient_descent(const compact_row<E>& v, bool positive,
+        T sample_weight = T{1})
+        -> T
+    {
+        util::arena::scope scope;
+        auto dense = scratch_vector<T>{v.rank()};
+        decode(v, dense);
+        return gradient_descent(dense, positive, sample_weight);
+    }
+
+    auto gradient_descent(const classification& c, T sample_weight = T{1})
+        -> T
+    {
+        return gradient_descent(c.vec, c.positive, sample_weight);
     }
 
     template<class Range,
@@ -135,10 +363,214 @@ public:
         >::type
     >
     void gradient_descent(Range&& rng) {
-        util::for_each(rng, [&](auto& c) { gradient_descent(c); });
+        gradient_descent(std::forward<Range>(rng), [](size_t, T) {});
+    }
+
+    // Like above, but calls observe(n, squared_error) after every step on n
+    // examples, with the sum of their squared errors before the step.
+    template<class Range, class Observer,
+        class = typename std::enable_if<
+            std::is_convertible<
+                typename std::decay<Range>::type::value_type,
+                classification
+            >::value
+        >::type
+    >
+    void gradient_descent(Range&& rng, Observer&& observe) {
+        if (config.batch_size > 1) {
+            auto first = begin(rng);
+            auto last = end(rng);
+            while (first != last) {
+                auto next = std::next(first, std::min<std::ptrdiff_t>(
+                    config.batch_size, std::distance(first, last)));
+                auto squared_error = gradient_descent_batch(first, next);
+                observe(static_cast<size_t>(std::distance(first, next)),
+                    squared_error);
+                first = next;
+            }
+        } else {
+            util::for_each(rng, [&](auto& c) {
+                observe(size_t{1}, util::square(gradient_descent(c)));
+            });
+        }
+        next_epoch();
+    }
+
+    // Applies the mean gradient of the error on the examples [first, last)
+    // in one optimizer step. The activations of all halfspaces on all
+    // examples are one (examples x rank) by (rank x halfspaces) matrix
+    // product, the weight gradients are the transposed product with the
+    // derivatives of the error. Returns the sum of the squared errors of
+    // the examples before the step.
+    template<class It>
+    auto gradient_descent_batch(It first, It last)
+        -> T
+    {
+        auto count = static_cast<size_t>(std::distance(first, last));
+        if (count == 0) {
+            return T{0};
+        }
+
+        util::arena::scope scope;
+        auto packed = pack_halfspaces(first->vec.rank());
+        auto n = packed.bias.size();
+        auto rank = packed.rank;
+        auto x = scratch<T>{};
+        auto activation = scratch<T>{};
+        forward_batch(packed, first, count, x, activation);
+
+        // activation becomes the derivative of the error by the input of
+        // each sigmoid
+        auto products = scratch<T>(weight.size());
+        auto others = scratch<T>(weight.size());
+        auto squared_error = T{0};
+        auto it = first;
+        for (auto b : indices(count)) {
+            auto a = activation.data() + b * n;
+            auto output = polytope_products(packed, a, products, others);
+            auto e = output - (it->positive ? T{1} : T{0});
+            squared_error += e * e;
+            auto diff = T{2} * e;
+            for (auto h : indices(n)) {
+                auto i = packed.polytope[h];
+                a[h] = diff * others[i] * products[i] * (T{1} - a[h]);
+            }
+            ++it;
+        }
+
+        auto weight_gradient = scratch<T>(n * rank);
+        util::gemm(util::transpose::yes, util::transpose::no, n, rank, count,
+            T{1} / count, activation.data(), n, x.data(), rank,
+            T{0}, weight_gradient.data(), rank);
+        auto bias_gradient = scratch<T>(n, T{0});
+        for (auto b : indices(count)) {
+            for (auto h : indices(n)) {
+                bias_gradient[h] += activation[b * n + h];
+            }
+        }
+
+        optim.next_step();
+        auto h = size_t{0};
+        for (auto i : indices(weight.size())) {
+            for (auto j : indices(weight[i].size())) {
+                optim.update(parameter_offset(i, j), weight[i][j], bias[i][j],
+                    weight_gradient.data() + h * rank,
+                    bias_gradient[h] / count);
+                h++;
+            }
+        }
+        return squared_error;
+    }
+
+    // Returns the outputs of the network for a range of examples, computed
+    // block by block with the batched forward pass, which evaluates all
+    // halfspaces. With an inference_epsilon, the examples are classified
+    // one by one instead, so that the early exit of classify applies.
+    template<class Range,
+        class = typename std::enable_if<
+            std::is_convertible<
+                typename std::decay<Range>::type::value_type,
+                classification
+            >::value
+        >::type
+    >
+    auto classify_batch(Range&& examples) const
+        -> std::vector<T>
+    {
+        return classify_batch(begin(examples), end(examples));
+    }
+
+    template<class It>
+    auto classify_batch(It first, It last) const
+        -> std::vector<T>
+    {
+        constexpr auto block_size = size_t{256};
+
+        auto result = std::vector<T>{};
+        if (first == last) {
+            return result;
+        }
+        if (config.inference_epsilon > T{0}) {
+            result.reserve(static_cast<size_t>(std::distance(first, last)));
+            for (; first != last; ++first) {
+                result.push_back(classify(first->vec));
+            }
+            return result;
+        }
+
+        util::arena::scope scope;
+        auto packed = pack_halfspaces(first->vec.rank());
+        auto n = packed.bias.size();
+        auto x = scratch<T>{};
+        auto activation = scratch<T>{};
+        auto products = scratch<T>(weight.size());
+        auto others = scratch<T>(weight.size());
+        while (first != last) {
+            auto count = static_cast<size_t>(std::min<std::ptrdiff_t>(
+                block_size, std::distance(first, last)));
+            forward_batch(packed, first, count, x, activation);
+            for (auto b : indices(count)) {
+                result.push_back(polytope_products(packed,
+                    activation.data() + b * n, products, others));
+            }
+            std::advance(first, count);
+        }
+        return result;
+    }
+
+    // Must be called after every pass over the training data, unless the
+    // range overload of gradient_descent is used.
+    void next_epoch() {
+        optim.next_epoch();
+    }
+
+    // Removes all halfspaces and polytopes whose activation differs by at
+    // most tolerance from a constant on the given examples: halfspaces that
+    // are always ~1 don't change the product of their polytope and polytopes
+    // that are always ~0 don't change the output of the network. Returns the
+    // number of removed halfspaces and polytopes.
+    auto prune(const std::vector<classification>& examples, T tolerance)
+        -> std::pair<size_t, size_t>
+    {
+        auto min_halfspace = std::vector<std::vector<T>>{};
+        auto max_polytope = std::vector<T>(weight.size(), T{0});
+        for (auto i : indices(weight.size())) {
+            min_halfspace.emplace_back(weight[i].size(), T{1});
+        }
+        for (auto& c : examples) {
+            for (auto i : indices(weight.size())) {
+                auto product = T{1};
+                for (auto j : indices(weight[i].size())) {
+                    auto h = halfspace(i, j, c.vec);
+                    min_halfspace[i][j] = std::min(min_halfspace[i][j], h);
+                    product *= h;
+                }
+                max_polytope[i] = std::max(max_polytope[i], product);
+            }
+        }
+
+        auto removed_halfspaces = size_t{0};
+        auto removed_polytopes = size_t{0};
+        for (auto i = weight.size(); i-- > 0; ) {
+            if (max_polytope[i] <= tolerance) {
+                weight.erase(begin(weight) + i);
+                bias.erase(begin(bias) + i);
+                removed_polytopes++;
+                continue;
+            }
+            for (auto j = weight[i].size(); j-- > 0; ) {
+                if (min_halfspace[i][j] >= T{1} - tolerance) {
+                    weight[i].erase(begin(weight[i]) + j);
+                    bias[i].erase(begin(bias[i]) + j);
+                    removed_halfspaces++;
+                }
+            }
+        }
+
+        return {removed_halfspaces, removed_polytopes};
     }
 
-    T quadratic_error(const classification& c) {
+    T quadratic_error(const classification& c) const {
         return util::square(error(c));
     }
 
@@ -150,7 +582,7 @@ public:
             >::value
         >::type
     >
-    T quadratic_error(Range&& data) {
+    T quadratic_error(Range&& data) const {
         auto error = std::vector<T>{};
         util::transform(data, std::back_inserter(error),
             [&](auto& c) { return quadratic_error(c); });
@@ -158,69 +590,358 @@ public:
     }
 
 private:
-    T error(const classification& c) {
-        return classify(c.vec) - (c.positive ? T{1} : T{0});
+    template<class V>
+    T error(const V& v, bool positive) const {
+        return output(v, T{0}) - (positive ? T{1} : T{0});
     }
 
-    template<class URBG>
-    static auto kmeans(std::vector<vector<T>> data,
-        size_t k, URBG&& gen, size_t iterations = 10)
+    T error(const classification& c) const {
+        return error(c.vec, c.positive);
+    }
+
+    // Initializes the network by k-means of the positive and negative rows
+    // of a sparse or compact matrix.
+    template<class Matrix, class Predicate, class URBG>
+    void initialize_matrix(const Matrix& features,
+        const std::vector<size_t>& selection, Predicate&& is_positive,
+        URBG&& gen)
+    {
+        if (selection.size() == 0)
+            throw std::invalid_argument("selection.size() == 0");
+
+        auto pos_rows = std::vector<size_t>{};
+        auto neg_rows = std::vector<size_t>{};
+        util::for_each(selection, [&](auto i) {
+            (is_positive(i) ? pos_rows : neg_rows).push_back(i);
+        });
+        auto pos_ctrds = kmeans(features, std::move(pos_rows),
+            config.polytope_count, gen, config.kmeans_iterations);
+        auto neg_ctrds = kmeans(features, std::move(neg_rows),
+            config.max_halfspaces, gen, config.kmeans_iterations);
+        initialize(pos_ctrds, neg_ctrds);
+    }
+
+    // Initializes the network from the centroids of the positive and
+    // negative examples row(i), i in pos_rows or neg_rows respectively.
+    template<class Row, class URBG>
+    void initialize(Row&& row, std::vector<size_t> pos_rows,
+        std::vector<size_t> neg_rows, URBG&& gen)
+    {
+        // Check that all input data has the same rank.
+        auto rank = row(pos_rows.size() > 0 ? pos_rows[0] : neg_rows[0]).rank();
+        for (auto rows : {&pos_rows, &neg_rows}) {
+            for (auto i : *rows) {
+                if (row(i).rank() != rank) {
+                    throw std::invalid_argument(
+                        "all examples must have the same rank");
+                }
+            }
+        }
+
+        // Initialize the network.
+        auto pos_ctrds = kmeans_rows(row, std::move(pos_rows),
+            config.polytope_count, gen, config.kmeans_iterations);
+        auto neg_ctrds = kmeans_rows(row, std::move(neg_rows),
+            config.max_halfspaces, gen, config.kmeans_iterations);
+        initialize(pos_ctrds, neg_ctrds);
+    }
+
+    // The k-means algorithm on the dense vectors row(i), i in rows. The
+    // memory used in addition to the input is O(rows.size() + k * rank).
+    template<class Row, class URBG>
+    static auto kmeans_rows(Row&& row, std::vector<size_t> rows,
+        size_t k, URBG&& gen, size_t iterations)
         -> std::vector<vector<T>>
     {
-        // Shuffle the input vector.
-        util::shuffle(data, std::forward<URBG>(gen));
+        // Sample the initial centroids through a permutation of the rows.
+        util::shuffle(rows, std::forward<URBG>(gen));
 
         // There have to be at least as many data elements as the number
         // of clusters to be calculated.
-        if (k > data.size()) {
+        if (k > rows.size()) {
             throw std::invalid_argument("too many clusters for given data");
         }
 
-        auto centroids = std::vector<vector<T>>(k);
-        util::copy_n(data, k, begin(centroids));
+        auto centroids = std::vector<vector<T>>{};
+        for (auto i : indices(k)) {
+            centroids.push_back(row(rows[i]));
+        }
 
-        // Iterate
-        auto clusters = std::vector<std::vector<vector<T>>>(k);
-        auto add_to_nearest_cluster = [&](const auto& vec) {
-            auto dist = std::vector<T>(centroids.size());
-            util::transform(centroids, begin(dist),
-                [&](auto& c) { return distance(vec, c); });
-            clusters[util::index(dist, util::min_element(dist))].push_back(vec);
+        // Iterate. The sums of the clusters are scratch vectors that are
+        // released at the end of every iteration.
+        using scratch_allocator = util::arena_allocator<scratch_vector<T>>;
+        auto counts = std::vector<size_t>(k);
+        auto assignment = std::vector<size_t>(rows.size());
+        auto nearest_cluster = [&](size_t i) {
+            auto& vec = row(i);
+            auto nearest = size_t{0};
+            auto nearest_distance = distance(vec, centroids[0]);
+            for (auto c : indices(size_t{1}, centroids.size())) {
+                auto d = distance(vec, centroids[c]);
+                if (d < nearest_distance) {
+                    nearest = c;
+                    nearest_distance = d;
+                }
+            }
+            return nearest;
         };
         while (iterations-- > 0) {
-            util::for_each(data, add_to_nearest_cluster);
-            util::transform(clusters, centroids.begin(),
-                [](auto& cluster) { return centroid(cluster); });
-            util::for_each(clusters, [](auto& v) { v.clear(); });
+            util::transform(util::execution::par, rows, begin(assignment),
+                nearest_cluster);
+
+            util::arena::scope scope;
+            auto sums = std::vector<scratch_vector<T>, scratch_allocator>(
+                k, scratch_vector<T>{centroids[0].rank()});
+            util::fill(counts, size_t{0});
+            for (auto i : indices(rows.size())) {
+                sums[assignment[i]] += row(rows[i]);
+                counts[assignment[i]]++;
+            }
+
+            // Empty clusters keep their previous centroid.
+            for (auto c : indices(k)) {
+                if (counts[c] > 0) {
+                    util::transform(sums[c], centroids[c].begin(),
+                        util::multiply_by(T{1} / counts[c]));
+                }
+            }
         }
 
         return centroids;
     }
 
-    auto halfspace(size_t i, size_t j, const vector<T>& v)
+    // k-means of the rows of a sparse or compact matrix. A distance costs
+    // one dot product, because the squared lengths of the centroids are
+    // computed once per iteration.
+    template<class Matrix, class URBG>
+    static auto kmeans_matrix(const Matrix& data, std::vector<size_t> rows,
+        size_t k, URBG&& gen, size_t iterations)
+        -> std::vector<vector<T>>
+    {
+        util::shuffle(rows, std::forward<URBG>(gen));
+
+        if (k > rows.size()) {
+            throw std::invalid_argument("too many clusters for given data");
+        }
+
+        auto centroids = std::vector<vector<T>>{};
+        for (auto i : indices(k)) {
+            centroids.push_back(to_dense<T>(data[rows[i]]));
+        }
+
+        auto squared_lengths = std::vector<T>(k);
+        auto counts = std::vector<size_t>(k);
+        auto assignment = std::vector<size_t>(rows.size());
+        auto nearest_cluster = [&](size_t row) {
+            // |v - c|^2 = |v|^2 - 2 v * c + |c|^2, where |v|^2 is the same
+            // for all clusters.
+            auto v = data[row];
+            auto nearest = size_t{0};
+            auto nearest_distance = std::numeric_limits<T>::infinity();
+            for (auto c : indices(centroids.size())) {
+                auto d = squared_lengths[c] - T{2} * (centroids[c] * v);
+                if (d < nearest_distance) {
+                    nearest = c;
+                    nearest_distance = d;
+                }
+            }
+            return nearest;
+        };
+        while (iterations-- > 0) {
+            util::transform(centroids, begin(squared_lengths),
+                [](auto& c) { return c * c; });
+            util::transform(util::execution::par, rows, begin(assignment),
+                nearest_cluster);
+
+            util::arena::scope scope;
+            using scratch_allocator = util::arena_allocator<scratch_vector<T>>;
+            auto sums = std::vector<scratch_vector<T>, scratch_allocator>(
+                k, scratch_vector<T>{data.rank()});
+            util::fill(counts, size_t{0});
+            for (auto i : indices(rows.size())) {
+                sums[assignment[i]] += data[rows[i]];
+                counts[assignment[i]]++;
+            }
+
+            for (auto c : indices(k)) {
+                if (counts[c] > 0) {
+                    util::transform(sums[c], centroids[c].begin(),
+                        util::multiply_by(T{1} / counts[c]));
+                }
+            }
+        }
+
+        return centroids;
+    }
+
+    void initialize(const std::vector<vector<T>>& pos_ctrds,
+        const std::vector<vector<T>>& neg_ctrds)
+    {
+        if (pos_ctrds.size() == 0 || neg_ctrds.size() == 0)
+            throw std::invalid_argument("no centroids given");
+        if (pos_ctrds.size() != config.polytope_count
+            || neg_ctrds.size() != config.max_halfspaces) {
+            throw std::invalid_argument("centroid count differs from config");
+        }
+        auto rank = pos_ctrds[0].rank();
+
+        // Allocate memory.
+        weight.resize(config.polytope_count);
+        bias.resize(config.polytope_count);
+        for (auto i : indices(config.polytope_count)) {
+            weight[i].resize(config.max_halfspaces, vector<T>(rank));
+            bias[i].resize(config.max_halfspaces);
+        }
+        optim = optimizer<T>{config.optimizer, config.alpha,
+            config.polytope_count * config.max_halfspaces * (rank.value + 1)};
+
+        for (auto i : indices(pos_ctrds.size())) {
+            for (auto j : indices(neg_ctrds.size())) {
+                util::arena::scope scope;
+                weight[i][j] = pos_ctrds[i];
+                weight[i][j] -= neg_ctrds[j];
+                weight[i][j] /= length(weight[i][j]);
+                auto center = scratch_vector<T>{pos_ctrds[i]};
+                center += neg_ctrds[j];
+                center *= T{0.5};
+                bias[i][j] = weight[i][j] * center;
+            }
+        }
+    }
+
+    template<class V>
+    auto output(const V& v, T epsilon) const
+        -> T
+    {
+        auto result = T{1};
+        for (auto i : indices(weight.size())) {
+            result *= T{1} - polytope(i, v, epsilon);
+            if (result < epsilon) {
+                break;
+            }
+        }
+
+        return T{1} - result;
+    }
+
+    template<class V>
+    auto halfspace(size_t i, size_t j, const V& v) const
         -> T
     {
         auto denom = T{1} + std::exp(-(weight[i][j] * v) - bias[i][j]);
 
-        // std::exp may return inf: print an error and return 1 / inf ~ 0
+        // std::exp may return inf: count it and return 1 / inf ~ 0
         if (std::isinf(denom)) {
-            std::cerr << "invalid denom: " << denom
-                << ", i: " << i << ", j: " << j
-                << ", weight * v: " << (weight[i][j] * v)
-                << ", bias: " << bias[i][j]
-                << "\n";
+            saturated_halfspaces().fetch_add(1, std::memory_order_relaxed);
             return T{0};
         }
 
         return T{1} / denom;
     }
 
-    auto polytope(size_t i, const vector<T>& v)
+    template<class U>
+    using scratch = std::vector<U, util::arena_allocator<U>>;
+
+    // The weights of all halfspaces as the rows of one matrix, with their
+    // biases and the index of their polytope.
+    struct packed_halfspaces {
+        size_t rank;
+        scratch<T> weight;
+        scratch<T> bias;
+        scratch<size_t> polytope;
+    };
+
+    auto pack_halfspaces(rank_t rank) const
+        -> packed_halfspaces
+    {
+        auto packed = packed_halfspaces{rank.value, {}, {}, {}};
+        for (auto i : indices(weight.size())) {
+            for (auto j : indices(weight[i].size())) {
+                if (weight[i][j].rank() != rank) {
+                    throw std::invalid_argument{"rank differs"};
+                }
+                packed.weight.insert(end(packed.weight),
+                    weight[i][j].begin(), weight[i][j].end());
+                packed.bias.push_back(bias[i][j]);
+                packed.polytope.push_back(i);
+            }
+        }
+        return packed;
+    }
+
+    // Copies the count examples starting at first into the rows of x and
+    // sets activation[b * n + h] to the output of halfspace h on example b.
+    template<class It>
+    void forward_batch(const packed_halfspaces& packed, It first,
+        size_t count, scratch<T>& x, scratch<T>& activation) const
+    {
+        auto n = packed.bias.size();
+        auto rank = packed.rank;
+        x.resize(count * rank);
+        activation.resize(count * n);
+        for (auto b : indices(count)) {
+            if (first->vec.rank().value != rank) {
+                throw std::invalid_argument{"rank differs"};
+            }
+            std::copy(first->vec.begin(), first->vec.end(),
+                x.begin() + b * rank);
+            ++first;
+        }
+
+        util::gemm(util::transpose::no, util::transpose::yes, count, n, rank,
+            T{1}, x.data(), rank, packed.weight.data(), rank,
+            T{0}, activation.data(), n);
+        for (auto b : indices(count)) {
+            for (auto h : indices(n)) {
+                auto& a = activation[b * n + h];
+                a = T{1} / (T{1} + std::exp(-a - packed.bias[h]));
+            }
+        }
+    }
+
+    // Returns the output of the network from the halfspace activations of
+    // one example. Sets products[i] to the output of polytope i and
+    // others[i] to the product of 1 - products[r] for all r != i.
+    auto polytope_products(const packed_halfspaces& packed,
+        const T* activation, scratch<T>& products, scratch<T>& others) const
+        -> T
+    {
+        std::fill(begin(products), end(products), T{1});
+        for (auto h : indices(packed.bias.size())) {
+            products[packed.polytope[h]] *= activation[h];
+        }
+        // prefix products in others, then multiplied by the suffix products
+        auto prefix = T{1};
+        for (auto i : indices(products.size())) {
+            others[i] = prefix;
+            prefix *= T{1} - products[i];
+        }
+        auto suffix = T{1};
+        for (auto i = products.size(); i-- > 0; ) {
+            others[i] *= suffix;
+            suffix *= T{1} - products[i];
+        }
+        return T{1} - prefix;
+    }
+
+    // Index of the first optimizer state entry of halfspace (i, j).
+    auto parameter_offset(size_t i, size_t j) const
+        -> size_t
+    {
+        auto rank = weight[i][j].rank().value;
+        return (i * config.max_halfspaces + j) * (rank + 1);
+    }
+
+    template<class V>
+    auto polytope(size_t i, const V& v, T epsilon = T{0}) const
         -> T
     {
         auto result = T{1};
-        for (auto j : indices(config.max_halfspaces)) {
+        for (auto j : indices(weight[i].size())) {
             result *= halfspace(i, j, v);
+            if (result < epsilon) {
+                break;
+            }
         }
         return result;
     }
@@ -230,6 +951,7 @@ private:
     config_t config;
     std::vector<std::vector<vector<T>>> weight;
     std::vector<std::vector<T>> bias;
+    optimizer<T> optim;
 };
 
 } // namespace ldnn
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "util/random.hpp"
+
+#include "data.hpp"
+#include "network.hpp"
+
+namespace ldnn {
+
+    // A network that is trained incrementally on a stream of examples. The
+    // first examples are buffered until the network can be initialized by
+    // k-means, later ones are applied in micro-batches. After every batch a
+    // snapshot of the network and the normalization statistics is published,
+    // which any number of scoring threads can read while training continues.
+    template<class T = double>
+    class online_learner {
+    public:
+        struct config_t {
+            // Number of examples that are buffered to initialize the
+            // network. Initialization is delayed until there are at least
+            // polytope_count positive and max_halfspaces negative examples,
+            // meanwhile at most warmup examples of each class, or as many as
+            // the initialization needs, are kept.
+            size_t warmup;
+
+            // Number of examples per micro-batch.
+            size_t batch_size;
+
+            // Number of trained examples after which the learning rate
+            // schedule advances by one epoch, 0 keeps the learning rate of
+            // the first epoch.
+            size_t epoch_size;
+        };
+
+        // The published state, everything needed to classify raw examples.
+        struct model {
+            network<T> net;
+            column_stats<T> stats;
+
+            // Number of examples the network has been trained on.
+            size_t examples;
+
+            auto classify(const vector<T>& raw) const
+                -> T
+            {
+                util::arena::scope scope;
+                auto v = scratch_vector<T>{raw};
+                stats.normalize(v);
+                return net.classify(v);
+            }
+        };
+
+    public:
+        online_learner(typename network<T>::config_t net_config,
+            config_t config, util::philox4x32 rng)
+            : net_config(net_config), config(config), rng(rng)
+        {
+            if (config.batch_size == 0) {
+                throw std::invalid_argument{"batch_size == 0"};
+            }
+        }
+
+        online_learner(const online_learner&) = delete;
+        online_learner& operator=(const online_learner&) = delete;
+
+        // Adds a labeled example with raw, unnormalized features. Returns
+        // true if a new model has been published. Must only be called by
+        // one thread at a time.
+        auto learn(vector<T> raw, bool positive)
+            -> bool
+        {
+            stats.update(raw);
+            if (!net && (positive ? positives : pending.size() - positives)
+                >= std::max({config.warmup, net_config.polytope_count,
+                    net_config.max_halfspaces})) {
+                return false;
+            }
+            pending.push_back({std::move(raw), positive});
+            positives += positive ? 1 : 0;
+
+            if (!net) {
+                if (pending.size() < config.warmup
+                    || positives < net_config.polytope_count
+                    || pending.size() - positives < net_config.max_halfspaces) {
+                    return false;
+                }
+                normalize_pending();
+                net = std::make_unique<network<T>>(
+                    net_config, pending, rng.stream(0));
+                train_pending();
+                return true;
+            }
+
+            if (pending.size() < config.batch_size) {
+                return false;
+            }
+            normalize_pending();
+            train_pending();
+            return true;
+        }
+
+        // Returns the latest published model, or nullptr while warming up.
+        // Safe to call from any thread.
+        auto current() const
+            -> std::shared_ptr<const model>
+        {
+            return std::atomic_load(&published);
+        }
+
+    private:
+        // Normalizes the pending batch with the statistics of all examples
+        // seen so far.
+        void normalize_pending() {
+            for (auto& c : pending) {
+                stats.normalize(c.vec);
+            }
+        }
+
+        void train_pending() {
+            for (auto& c : pending) {
+                net->gradient_descent(c);
+                trained++;
+                if (config.epoch_size > 0 && trained % config.epoch_size == 0) {
+                    net->next_epoch();
+                }
+            }
+            pending.clear();
+            positives = 0;
+
+            std::atomic_store(&published, std::shared_ptr<const model>{
+                std::make_shared<model>(model{*net, stats, trained})});
+        }
+
+    private:
+        typename network<T>::config_t net_config;
+        config_t config;
+        util::philox4x32 rng;
+
+        std::unique_ptr<network<T>> net;
+        column_stats<T> stats;
+        std::vector<typename network<T>::classification> pending;
+        size_t positives = 0;
+        size_t trained = 0;
+
+        std::shared_ptr<const model> published;
+    };
+
+} // namespace ldnn
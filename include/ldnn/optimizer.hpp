@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ldnn/sparse_vector.hpp"
+#include "ldnn/vector.hpp"
+
+namespace ldnn {
+
+enum class optimizer_type {
+    sgd,
+    momentum,
+    nesterov,
+    adam
+};
+
+enum class schedule_type {
+    // The learning rate stays alpha.
+    constant,
+
+    // The learning rate is multiplied by decay every decay_step epochs.
+    step,
+
+    // The learning rate is alpha * decay^epoch.
+    exponential,
+
+    // The learning rate is alpha / (1 + decay * epoch).
+    inverse_time
+};
+
+// Applies the gradients computed by the network to its weights and biases.
+// The state of the optimizer (moments) is stored in contiguous buffers that
+// contain one entry per weight and bias, laid out halfspace by halfspace.
+template<class T = double>
+class optimizer {
+    static_assert(std::is_floating_point<T>::value,
+        "T has to be a floating-point type");
+
+public:
+    struct config_t {
+        optimizer_type type;
+
+        // Decay rate of the first moment (momentum, nesterov and adam).
+        T beta1;
+
+        // Decay rate of the second moment (adam).
+        T beta2;
+
+        // Term added to the denominator for numerical stability (adam).
+        T epsilon;
+
+        schedule_type schedule;
+
+        // Decay factor of the learning rate schedule.
+        T decay;
+
+        // Number of epochs between two decays of the step schedule.
+        size_t decay_step;
+    };
+
+    // Everything that changes during training, to save and restore it.
+    struct state_t {
+        size_t step;
+        size_t epoch;
+        std::vector<T> first_moment;
+        std::vector<T> second_moment;
+    };
+
+public:
+    static config_t read_config(const INIReader& ini_config) {
+        auto config = config_t{};
+
+        auto type = ini_config.Get("optimizer", "type", "sgd");
+        if (type == "sgd") {
+            config.type = optimizer_type::sgd;
+        } else if (type == "momentum") {
+            config.type = optimizer_type::momentum;
+        } else if (type == "nesterov") {
+            config.type = optimizer_type::nesterov;
+        } else if (type == "adam") {
+            config.type = optimizer_type::adam;
+        } else {
+            throw std::invalid_argument{"The value " + type
+                + " is not valid for parameter optimizer.type!"};
+        }
+        config.beta1 = ini_config.GetReal("optimizer", "beta1", 0.9);
+        config.beta2 = ini_config.GetReal("optimizer", "beta2", 0.999);
+        config.epsilon = ini_config.GetReal("optimizer", "epsilon", 1e-8);
+
+        auto schedule = ini_config.Get("optimizer", "schedule", "constant");
+        if (schedule == "constant") {
+            config.schedule = schedule_type::constant;
+        } else if (schedule == "step") {
+            config.schedule = schedule_type::step;
+        } else if (schedule == "exponential") {
+            config.schedule = schedule_type::exponential;
+        } else if (schedule == "inverse_time") {
+            config.schedule = schedule_type::inverse_time;
+        } else {
+            throw std::invalid_argument{"The value " + schedule
+                + " is not valid for parameter optimizer.schedule!"};
+        }
+        config.decay = ini_config.GetReal("optimizer", "decay", 1.0);
+        config.decay_step = static_cast<size_t>(
+            ini_config.GetInteger("optimizer", "decay_step", 1));
+
+        return config;
+    }
+
+public:
+    optimizer() = default;
+
+    optimizer(config_t config, T alpha, size_t parameter_count)
+        : config(config), alpha(alpha), rate(alpha)
+    {
+        if (config.type != optimizer_type::sgd) {
+            first_moment.resize(parameter_count, T{0});
+        }
+        if (config.type == optimizer_type::adam) {
+            second_moment.resize(parameter_count, T{0});
+        }
+    }
+
+    // Updates the weight w and bias b of the halfspace whose state starts at
+    // offset. The gradient of the weight is scale * v, the gradient of the
+    // bias is scale.
+    template<class A>
+    void update(size_t offset, vector<T>& w, T& b, T scale,
+        const vector<T, A>& v)
+    {
+        for (auto k : indices(w.rank())) {
+            w[k] -= delta(offset + k, scale * v[k]);
+        }
+        b -= delta(offset + w.rank().value, scale);
+    }
+
+    // Like update, but only touches the weights of the non-zero entries of
+    // v. The moments of the other weights are not decayed in the meantime,
+    // which is exact for sgd and the usual lazy approximation otherwise.
+    void update(size_t offset, vector<T>& w, T& b, T scale,
+        const sparse_row<T>& v)
+    {
+        for (auto k : indices(v.nnz)) {
+            auto index = v.index[k];
+            w[index] -= delta(offset + index, scale * v.value[k]);
+        }
+        b -= delta(offset + w.rank().value, scale);
+    }
+
+    // Updates the weight w and bias b of the halfspace whose state starts at
+    // offset, given the gradient of the weight in gradient[0, rank) and the
+    // gradient of the bias.
+    void update(size_t offset, vector<T>& w, T& b, const T* gradient,
+        T bias_gradient)
+    {
+        for (auto k : indices(w.rank())) {
+            w[k] -= delta(offset + k, gradient[k]);
+        }
+        b -= delta(offset + w.rank().value, bias_gradient);
+    }
+
+    // Must be called once per example or batch, before its updates are
+    // applied.
+    void next_step() {
+        step++;
+        update_corrections();
+    }
+
+    // Must be called after every pass over the training data.
+    void next_epoch() {
+        epoch++;
+        update_rate();
+    }
+
+    auto learning_rate() const
+        -> T
+    {
+        return rate;
+    }
+
+    auto state() const
+        -> state_t
+    {
+        return {step, epoch, first_moment, second_moment};
+    }
+
+    void set_state(state_t state) {
+        if (state.first_moment.size() != first_moment.size()
+            || state.second_moment.size() != second_moment.size()) {
+            throw std::invalid_argument{"optimizer state size differs"};
+        }
+        step = state.step;
+        epoch = state.epoch;
+        first_moment = std::move(state.first_moment);
+        second_moment = std::move(state.second_moment);
+        update_corrections();
+        update_rate();
+    }
+
+private:
+    void update_corrections() {
+        if (config.type == optimizer_type::adam && step > 0) {
+            correction1 = T{1} - std::pow(config.beta1, static_cast<T>(step));
+            correction2 = T{1} - std::pow(config.beta2, static_cast<T>(step));
+        }
+    }
+
+    void update_rate() {
+        switch (config.schedule) {
+        case schedule_type::constant:
+            rate = alpha;
+            break;
+        case schedule_type::step:
+            rate = alpha * std::pow(config.decay,
+                static_cast<T>(epoch / std::max<size_t>(config.decay_step, 1)));
+            break;
+        case schedule_type::exponential:
+            rate = alpha * std::pow(config.decay, static_cast<T>(epoch));
+            break;
+        case schedule_type::inverse_time:
+            rate = alpha / (T{1} + config.decay * epoch);
+            break;
+        }
+    }
+
+    // Returns the value that has to be subtracted from the parameter at
+    // index, given its gradient g.
+    auto delta(size_t index, T g)
+        -> T
+    {
+        switch (config.type) {
+        case optimizer_type::sgd:
+            return rate * g;
+        case optimizer_type::momentum: {
+            auto& m = first_moment[index];
+            m = config.beta1 * m + g;
+            return rate * m;
+        }
+        case optimizer_type::nesterov: {
+            auto& m = first_moment[index];
+            m = config.beta1 * m + g;
+            return rate * (g + config.beta1 * m);
+        }
+        case optimizer_type::adam: {
+            auto& m = first_moment[index];
+            auto& v = second_moment[index];
+            m = config.beta1 * m + (T{1} - config.beta1) * g;
+            v = config.beta2 * v + (T{1} - config.beta2) * g * g;
+            return rate * (m / correction1)
+                / (std::sqrt(v / correction2) + config.epsilon);
+        }
+        }
+        return T{0};
+    }
+
+private:
+    config_t config = {};
+    T alpha = T{0};
+    T rate = T{0};
+    size_t step = 0;
+    size_t epoch = 0;
+    T correction1 = T{1};
+    T correction2 = T{1};
+    std::vector<T> first_moment;
+    std::vector<T> second_moment;
+};
+
+} // namespace ldnn
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512VNNI__)
+#include <immintrin.h>
+#endif
+
+#include "network.hpp"
+
+namespace ldnn {
+
+    namespace detail {
+
+        // Dot product of n unsigned 7-bit features and signed 8-bit weights.
+        inline auto dot_u8s8(const uint8_t* x, const int8_t* w, size_t n)
+            -> int32_t
+        {
+            auto acc = int32_t{0};
+            auto i = size_t{0};
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+            auto acc512 = _mm512_setzero_si512();
+            for (; i + 64 <= n; i += 64) {
+                acc512 = _mm512_dpbusd_epi32(acc512,
+                    _mm512_loadu_si512(x + i), _mm512_loadu_si512(w + i));
+            }
+            int32_t lanes[16];
+            _mm512_storeu_si512(lanes, acc512);
+            for (auto lane : lanes) {
+                acc += lane;
+            }
+#endif
+#if defined(__AVX2__)
+            // maddubs adds two products of at most 127 * 127, so its 16-bit
+            // results don't saturate for 7-bit features.
+            auto ones = _mm256_set1_epi16(1);
+            auto acc256 = _mm256_setzero_si256();
+            for (; i + 32 <= n; i += 32) {
+                auto xv = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(x + i));
+                auto wv = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(w + i));
+                acc256 = _mm256_add_epi32(acc256, _mm256_madd_epi16(
+                    _mm256_maddubs_epi16(xv, wv), ones));
+            }
+            auto sum = _mm_add_epi32(_mm256_castsi256_si128(acc256),
+                _mm256_extracti128_si256(acc256, 1));
+            sum = _mm_hadd_epi32(sum, sum);
+            sum = _mm_hadd_epi32(sum, sum);
+            acc += _mm_cvtsi128_si32(sum);
+#endif
+            for (; i < n; ++i) {
+                acc += static_cast<int32_t>(x[i]) * w[i];
+            }
+            return acc;
+        }
+
+        // Approximates the logistic function by linear interpolation in a
+        // table over [-range, range].
+        class sigmoid_table {
+        public:
+            sigmoid_table(size_t size = 4096, float range = 16.0f)
+                : range(range), step_inv((size - 1) / (2 * range))
+            {
+                for (size_t i = 0; i < size; ++i) {
+                    auto z = -range + i / step_inv;
+                    values.push_back(1.0f / (1.0f + std::exp(-z)));
+                }
+            }
+
+            auto operator()(float z) const
+                -> float
+            {
+                auto pos = (std::min(std::max(z, -range), range) + range)
+                    * step_inv;
+                auto i = std::min(static_cast<size_t>(pos), values.size() - 2);
+                auto frac = pos - i;
+                return values[i] + frac * (values[i + 1] - values[i]);
+            }
+
+        private:
+            float range;
+            float step_inv;
+            std::vector<float> values;
+        };
+
+    } // namespace detail
+
+// A network whose weights are quantized to int8 with one scale per halfspace
+// and whose inputs are quantized to 7 bits. Inputs are expected to be
+// normalized to [0, 1].
+template<class T = double>
+class quantized_network {
+public:
+    explicit quantized_network(const network<T>& net)
+        : epsilon(static_cast<float>(net.get_config().inference_epsilon))
+    {
+        auto& weights = net.weights();
+        auto& biases = net.biases();
+        rank = 0;
+        for (auto& polytope : weights) {
+            for (auto& w : polytope) {
+                rank = w.rank().value;
+            }
+        }
+
+        for (auto i : indices(weights.size())) {
+            polytope_end.push_back(polytope_end.size() > 0
+                ? polytope_end.back() : 0);
+            for (auto j : indices(weights[i].size())) {
+                auto& w = weights[i][j];
+                auto max = T{0};
+                for (auto e : w) {
+                    max = std::max(max, std::abs(e));
+                }
+                auto w_scale = max > 0 ? max / T{127} : T{1};
+                for (auto e : w) {
+                    qweight.push_back(
+                        static_cast<int8_t>(std::lround(e / w_scale)));
+                }
+                scale.push_back(static_cast<float>(w_scale / max_feature));
+                bias.push_back(static_cast<float>(biases[i][j]));
+                polytope_end.back()++;
+            }
+        }
+    }
+
+    auto classify(const vector<T>& v) const
+        -> float
+    {
+        if (v.rank().value != rank) {
+            throw std::invalid_argument{"rank differs"};
+        }
+
+        util::arena::scope scope;
+        auto x = std::vector<uint8_t, util::arena_allocator<uint8_t>>(rank);
+        for (auto k : indices(rank)) {
+            x[k] = static_cast<uint8_t>(std::lround(
+                std::min(std::max(v[k], T{0}), T{1}) * max_feature));
+        }
+
+        auto result = 1.0f;
+        auto h = size_t{0};
+        for (auto end : polytope_end) {
+            auto product = 1.0f;
+            for (; h < end; ++h) {
+                auto z = scale[h] * detail::dot_u8s8(
+                    x.data(), qweight.data() + h * rank, rank) + bias[h];
+                product *= sigmoid(z);
+                if (product < epsilon) {
+                    break;
+                }
+            }
+            h = end;
+            result *= 1.0f - product;
+            if (result < epsilon) {
+                break;
+            }
+        }
+        return 1.0f - result;
+    }
+
+    // Size of the weights, scales and biases in bytes.
+    auto model_size() const
+        -> size_t
+    {
+        return qweight.size() * sizeof(int8_t)
+            + (scale.size() + bias.size()) * sizeof(float);
+    }
+
+private:
+    static constexpr T max_feature = 127;
+
+    size_t rank;
+    float epsilon;
+
+    // Index of the first halfspace after polytope i.
+    std::vector<size_t> polytope_end;
+
+    // The weights of halfspace h start at qweight[h * rank].
+    std::vector<int8_t> qweight;
+    std::vector<float> scale;
+    std::vector<float> bias;
+
+    detail::sigmoid_table sigmoid;
+};
+
+template<class T>
+auto model_size(const network<T>& net)
+    -> size_t
+{
+    auto size = size_t{0};
+    for (auto i : indices(net.weights().size())) {
+        for (auto& w : net.weights()[i]) {
+            size += (w.rank().value + 1) * sizeof(T);
+        }
+    }
+    return size;
+}
+
+// Differences between the outputs of a network and its quantized version.
+struct quantization_report {
+    // Fractions of correctly classified examples.
+    double float_accuracy;
+    double quantized_accuracy;
+
+    // Fraction of examples that both networks assign to the same class.
+    double agreement;
+
+    double mean_abs_diff;
+    double max_abs_diff;
+};
+
+template<class T>
+auto compare(const network<T>& net, const quantized_network<T>& qnet,
+    const std::vector<typename network<T>::classification>& examples)
+    -> quantization_report
+{
+    auto report = quantization_report{};
+    for (auto& c : examples) {
+        auto f = net.classify(c.vec);
+        auto q = qnet.classify(c.vec);
+        report.float_accuracy += (f > 0.5) == c.positive;
+        report.quantized_accuracy += (q > 0.5) == c.positive;
+        report.agreement += (f > 0.5) == (q > 0.5);
+        auto diff = std::abs(static_cast<double>(f) - q);
+        report.mean_abs_diff += diff;
+        report.max_abs_diff = std::max(report.max_abs_diff, diff);
+    }
+    if (examples.size() > 0) {
+        report.float_accuracy /= examples.size();
+        report.quantized_accuracy /= examples.size();
+        report.agreement /= examples.size();
+        report.mean_abs_diff /= examples.size();
+    }
+    return report;
+}
+
+} // namespace ldnn
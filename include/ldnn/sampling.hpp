@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "network.hpp"
+
+namespace ldnn {
+
+// Chooses the examples of an epoch by importance: every example is drawn
+// with a probability that is proportional to the magnitude of its error
+// when it was last trained on, mixed with a uniform distribution. Each
+// draw is weighted by 1 / (size * probability), so that the expected
+// gradient of a drawn example is the mean gradient of all examples.
+template<class T = double>
+class importance_sampler {
+public:
+    struct config_t {
+        // Number of draws per sampled epoch, as a fraction of the number
+        // of examples. A value of 0 disables sampling.
+        T fraction;
+
+        // Weight of the uniform distribution in the mixture. It bounds the
+        // weight of a draw by 1 / uniform and keeps examples whose error
+        // is stale from being starved.
+        T uniform;
+
+        // Every full_pass_interval-th epoch, starting with the first,
+        // visits all examples and measures all errors.
+        size_t full_pass_interval;
+    };
+
+    struct draw {
+        size_t index;
+        T weight;
+    };
+
+public:
+    importance_sampler(config_t config, size_t size)
+        : config(config), errors(size, T{1})
+    {
+        if (config.fraction <= T{0} || config.fraction > T{1}) {
+            throw std::invalid_argument{"sampling.fraction not in (0, 1]"};
+        }
+        if (config.uniform <= T{0} || config.uniform > T{1}) {
+            throw std::invalid_argument{"sampling.uniform not in (0, 1]"};
+        }
+        if (config.full_pass_interval == 0) {
+            throw std::invalid_argument{"sampling.full_pass_interval == 0"};
+        }
+    }
+
+    auto full_pass(size_t epoch) const
+        -> bool
+    {
+        return epoch % config.full_pass_interval == 0;
+    }
+
+    // Number of examples drawn by a sampled epoch.
+    auto draws() const
+        -> size_t
+    {
+        return std::max<size_t>(1, static_cast<size_t>(
+            std::round(config.fraction * errors.size())));
+    }
+
+    // Number of examples that are trained on in the epochs before epoch.
+    auto examples_before(size_t epoch) const
+        -> size_t
+    {
+        auto full_passes = (epoch + config.full_pass_interval - 1)
+            / config.full_pass_interval;
+        return full_passes * errors.size() + (epoch - full_passes) * draws();
+    }
+
+    template<class URBG>
+    auto sample(URBG&& gen) const
+        -> std::vector<draw>
+    {
+        auto n = errors.size();
+        auto total = std::accumulate(begin(errors), end(errors), T{0});
+        auto cumulative = std::vector<T>(n);
+        auto sum = T{0};
+        for (auto i : indices(n)) {
+            sum += probability(i, total);
+            cumulative[i] = sum;
+        }
+
+        auto count = draws();
+        auto uniform = std::uniform_real_distribution<T>{T{0}, sum};
+        auto result = std::vector<draw>{};
+        result.reserve(count);
+        for (auto k = count; k-- > 0; ) {
+            auto i = static_cast<size_t>(std::distance(begin(cumulative),
+                std::upper_bound(begin(cumulative), end(cumulative),
+                    uniform(gen))));
+            i = std::min(i, n - 1);
+            result.push_back({i, T{1} / (n * probability(i, total))});
+        }
+        return result;
+    }
+
+    // Records the error of example i after it has been trained on.
+    void update(size_t i, T error) {
+        errors[i] = std::abs(error);
+    }
+
+    // The last errors of all examples, to save and restore them.
+    auto last_errors() const
+        -> const std::vector<T>&
+    {
+        return errors;
+    }
+
+    void set_last_errors(std::vector<T> e) {
+        if (e.size() != errors.size()) {
+            throw std::invalid_argument{"number of errors differs"};
+        }
+        errors = std::move(e);
+    }
+
+private:
+    auto probability(size_t i, T total) const
+        -> T
+    {
+        auto n = static_cast<T>(errors.size());
+        if (total <= T{0}) {
+            return T{1} / n;
+        }
+        return (T{1} - config.uniform) * errors[i] / total
+            + config.uniform / n;
+    }
+
+private:
+    config_t config;
+    std::vector<T> errors;
+};
+
+    // Trains net for one epoch on the examples chosen by sampler: all of
+    // them in a random order on full passes, weighted draws otherwise.
+    // Calls observe(1, squared_error) after every example. The learning
+    // rate schedule advances once per examples.size() trained examples, not
+    // per epoch, so that the cheaper sampled epochs don't decay it faster.
+    template<class T, class URBG, class Observer>
+    void importance_epoch(network<T>& net,
+        const std::vector<typename network<T>::classification>& examples,
+        importance_sampler<T>& sampler, size_t epoch, URBG&& gen,
+        Observer&& observe)
+    {
+        auto train = [&](size_t i, T weight) {
+            auto error = net.gradient_descent(examples[i], weight);
+            sampler.update(i, error);
+            observe(size_t{1}, error * error);
+        };
+        if (sampler.full_pass(epoch)) {
+            auto order = std::vector<size_t>(examples.size());
+            std::iota(begin(order), end(order), size_t{0});
+            util::shuffle(order, gen);
+            for (auto i : order) {
+                train(i, T{1});
+            }
+        } else {
+            for (auto& d : sampler.sample(gen)) {
+                train(d.index, d.weight);
+            }
+        }
+        auto n = examples.size();
+        for (auto k = sampler.examples_before(epoch) / n;
+            k < sampler.examples_before(epoch + 1) / n; ++k) {
+            net.next_epoch();
+        }
+    }
+
+    template<class T, class URBG>
+    void importance_epoch(network<T>& net,
+        const std::vector<typename network<T>::classification>& examples,
+        importance_sampler<T>& sampler, size_t epoch, URBG&& gen)
+    {
+        importance_epoch(net, examples, sampler, epoch,
+            std::forward<URBG>(gen), [](size_t, T) {});
+    }
+
+} // namespace ldnn
@@ -0,0 +1,496 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util/hash.hpp"
+#include "util/shared_memory.hpp"
+
+#include "compact_vector.hpp"
+
+namespace ldnn {
+
+    // A dataset whose features are encoded with E in a shared memory
+    // segment. It is only read, by any number of processes at once.
+    template<class E, class T = double>
+    struct shared_dataset {
+        using features_type = compact_matrix<E,
+            util::shared_array<typename E::storage_type>>;
+
+        features_type features;
+        util::shared_array<T> labels;
+
+        // Whether the segment was published by another process, rather than
+        // loaded by this one.
+        bool attached;
+    };
+
+    namespace detail {
+
+        static_assert(ATOMIC_INT_LOCK_FREE == 2,
+            "shared datasets need lock-free atomics");
+
+        constexpr char shared_dataset_magic[8] =
+            {'L', 'D', 'N', 'N', 'S', 'H', 'M', '3'};
+
+        // The beginning of a shared dataset segment. It is followed by the
+        // key, the path and the identity of the file, then the encoded
+        // features and the labels. The strings, the features and the labels
+        // start at a multiple of shared_dataset_alignment.
+        struct shared_dataset_header {
+            // Written last when the segment is created, so that a segment
+            // with the magic has its strings.
+            char magic[8];
+
+            // Set to 1 by the creator once everything else is written.
+            std::atomic<uint32_t> ready;
+
+            // Process id of the creator, to detect one that died.
+            int32_t creator;
+
+            // Whether the segment stays after its last user has detached,
+            // otherwise every user holds a lock on it, see
+            // util::shared_memory::remove_when_unused.
+            uint32_t persistent;
+
+            uint64_t key_size;
+            uint64_t path_size;
+            uint64_t identity_size;
+            uint64_t rank;
+            uint64_t rows;
+            uint64_t storage_size;
+            uint64_t label_size;
+        };
+
+        constexpr size_t shared_dataset_alignment = 64;
+
+        inline auto align_shared(size_t offset)
+            -> size_t
+        {
+            return (offset + shared_dataset_alignment - 1)
+                / shared_dataset_alignment * shared_dataset_alignment;
+        }
+
+        // Offsets of the parts of a segment, and its total size.
+        struct shared_dataset_layout {
+            size_t key;
+            size_t path;
+            size_t identity;
+            size_t features;
+            size_t labels;
+            size_t size;
+
+            explicit shared_dataset_layout(const shared_dataset_header& h)
+                : key(align_shared(sizeof(shared_dataset_header))),
+                  path(key + h.key_size),
+                  identity(path + h.path_size),
+                  features(align_shared(identity + h.identity_size)),
+                  labels(align_shared(
+                      features + h.rows * h.rank * h.storage_size)),
+                  size(labels + h.rows * h.label_size)
+            {}
+        };
+
+        inline auto process_exists(int32_t pid)
+            -> bool
+        {
+            return ::kill(pid, 0) == 0 || errno != ESRCH;
+        }
+
+        // The path and the identity of the file of a shared dataset.
+        struct shared_dataset_source {
+            std::string path;
+            std::string identity;
+        };
+
+        // Returns the source of the dataset in segment, or false if the
+        // segment isn't a complete shared dataset header yet.
+        inline auto read_source(const util::shared_memory& segment,
+            shared_dataset_source& source)
+            -> bool
+        {
+            if (segment.size() < sizeof(shared_dataset_header)) {
+                return false;
+            }
+            auto bytes = static_cast<const char*>(segment.data());
+            auto& header =
+                *reinterpret_cast<const shared_dataset_header*>(bytes);
+            if (std::memcmp(header.magic, shared_dataset_magic,
+                    sizeof(header.magic)) != 0) {
+                return false;
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            auto layout = shared_dataset_layout{header};
+            if (segment.size() < layout.features) {
+                return false;
+            }
+            source.path.assign(bytes + layout.path, header.path_size);
+            source.identity.assign(bytes + layout.identity,
+                header.identity_size);
+            return true;
+        }
+
+        // Calls f(name, source) for every shared dataset segment in
+        // /dev/shm, where POSIX shared memory is kept on Linux.
+        template<class F>
+        void for_each_shared_dataset(F&& f) {
+            auto dir = std::unique_ptr<DIR, int(*)(DIR*)>{
+                ::opendir("/dev/shm"), ::closedir};
+            if (!dir) {
+                return;
+            }
+            auto names = std::vector<std::string>{};
+            while (auto entry = ::readdir(dir.get())) {
+                if (std::strncmp(entry->d_name, "ldnn-", 5) == 0) {
+                    names.push_back(std::string{"/"} + entry->d_name);
+                }
+            }
+            for (auto& name : names) {
+                auto segment = util::shared_memory::open(name);
+                auto source = shared_dataset_source{};
+                if (segment && read_source(*segment, source)) {
+                    f(name, source);
+                }
+            }
+        }
+
+        // Returns the dataset in segment if it has been published with
+        // the given key, or nullptr if it is still being written.
+        template<class E, class T>
+        auto attach_shared(std::shared_ptr<const util::shared_memory> segment,
+            const std::string& key)
+            -> std::unique_ptr<shared_dataset<E, T>>
+        {
+            auto bytes = static_cast<const char*>(segment->data());
+            auto& header =
+                *reinterpret_cast<const shared_dataset_header*>(bytes);
+            if (std::memcmp(header.magic, shared_dataset_magic,
+                    sizeof(header.magic)) != 0
+                || header.ready.load(std::memory_order_acquire) == 0) {
+                return nullptr;
+            }
+
+            auto layout = shared_dataset_layout{header};
+            if (segment->size() < layout.size) {
+                // mapped before the creator grew the segment
+                return nullptr;
+            }
+            if (header.storage_size != sizeof(typename E::storage_type)
+                || header.label_size != sizeof(T)
+                || std::string(bytes + layout.key, header.key_size) != key) {
+                throw std::runtime_error{
+                    "shared memory segment of another dataset"};
+            }
+
+            using storage_type = typename E::storage_type;
+            auto features = util::shared_array<storage_type>{segment,
+                reinterpret_cast<const storage_type*>(bytes + layout.features),
+                header.rows * header.rank};
+            auto labels = util::shared_array<T>{segment,
+                reinterpret_cast<const T*>(bytes + layout.labels),
+                header.rows};
+            return std::unique_ptr<shared_dataset<E, T>>{
+                new shared_dataset<E, T>{
+                    {rank_t{header.rank}, std::move(features)},
+                    std::move(labels), true}};
+        }
+
+        // Writes a dataset row by row into segment, whose header already
+        // holds the creator and the strings, see share_dataset.
+        template<class E, class T>
+        class shared_dataset_writer {
+        public:
+            explicit shared_dataset_writer(util::shared_memory& segment)
+                : segment(segment)
+            {}
+
+            // Sets the number of rows and their rank, which grows the
+            // segment to its full size. Has to be called once, before the
+            // rows are written.
+            void allocate(size_t rows, rank_t rank) {
+                if (rows == 0) {
+                    throw std::invalid_argument{"the input data is empty"};
+                }
+                {
+                    auto& header = *static_cast<shared_dataset_header*>(
+                        segment.data());
+                    header.rank = rank.value;
+                    header.rows = rows;
+                    header.storage_size = sizeof(typename E::storage_type);
+                    header.label_size = sizeof(T);
+                    // The segment is mapped again at its full size.
+                    segment.resize(shared_dataset_layout{header}.size);
+                }
+
+                auto bytes = static_cast<char*>(segment.data());
+                auto& header = *reinterpret_cast<shared_dataset_header*>(bytes);
+                auto layout = shared_dataset_layout{header};
+                features = reinterpret_cast<typename E::storage_type*>(
+                    bytes + layout.features);
+                labels = reinterpret_cast<T*>(bytes + layout.labels);
+                this->rank = rank;
+                remaining = rows;
+            }
+
+            template<class V>
+            void push_back(const V& row, T label) {
+                if (remaining == 0) {
+                    throw std::logic_error{"more rows than allocated"};
+                }
+                if (row.rank() != rank) {
+                    throw std::invalid_argument{"rank differs"};
+                }
+                using value_type = typename E::value_type;
+                for (auto x : row) {
+                    *features++ = E::encode(static_cast<value_type>(x));
+                }
+                *labels++ = label;
+                remaining--;
+            }
+
+            // Marks the segment as ready once all rows have been written.
+            void publish() {
+                if (!features || remaining > 0) {
+                    throw std::logic_error{"fewer rows than allocated"};
+                }
+                static_cast<shared_dataset_header*>(segment.data())
+                    ->ready.store(1, std::memory_order_release);
+            }
+
+        private:
+            util::shared_memory& segment;
+            rank_t rank = {0};
+            size_t remaining = 0;
+            typename E::storage_type* features = nullptr;
+            T* labels = nullptr;
+        };
+
+    } // namespace detail
+
+    // Identifies the current contents of a file by its device, inode, size
+    // and modification time.
+    inline auto file_identity(const std::string& filename)
+        -> std::string
+    {
+        struct stat info = {};
+        if (::stat(filename.c_str(), &info) != 0) {
+            throw std::invalid_argument{filename + " couldn't be opened!"};
+        }
+        return std::to_string(info.st_dev) + ":"
+            + std::to_string(info.st_ino) + ":"
+            + std::to_string(info.st_size) + ":"
+            + std::to_string(info.st_mtim.tv_sec) + "."
+            + std::to_string(info.st_mtim.tv_nsec);
+    }
+
+    // Returns the absolute path of filename without symbolic links, also
+    // once the file has been deleted, as long as its directory exists.
+    inline auto canonical_path(const std::string& filename)
+        -> std::string
+    {
+        auto resolve = [](const std::string& path, std::string& result) {
+            auto resolved = std::unique_ptr<char, void(*)(void*)>{
+                ::realpath(path.c_str(), nullptr), std::free};
+            if (resolved) {
+                result = resolved.get();
+            }
+            return static_cast<bool>(resolved);
+        };
+        auto result = std::string{};
+        if (resolve(filename, result)) {
+            return result;
+        }
+        auto slash = filename.rfind('/');
+        auto dir = slash == std::string::npos ? std::string{"."}
+            : slash == 0 ? std::string{"/"} : filename.substr(0, slash);
+        if (resolve(dir, result)) {
+            return (result == "/" ? result : result + "/")
+                + filename.substr(slash == std::string::npos ? 0 : slash + 1);
+        }
+        return filename;
+    }
+
+    // The name of the shared memory segment of the dataset with the given
+    // path, identity and key, /ldnn-<hash of them>.
+    inline auto shared_dataset_name(const std::string& path,
+        const std::string& identity, const std::string& key)
+        -> std::string
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/ldnn-%016llx",
+            static_cast<unsigned long long>(
+                util::fnv1a(path + "\n" + identity + "\n" + key)));
+        return name;
+    }
+
+    // Removes all shared datasets of the file filename, whatever their key
+    // and whether or not the file still exists. Processes that have
+    // attached to them keep their mapping. Returns the number of removed
+    // datasets.
+    inline auto unshare_dataset(const std::string& filename)
+        -> size_t
+    {
+        auto path = canonical_path(filename);
+        auto removed = size_t{0};
+        detail::for_each_shared_dataset([&](const std::string& name,
+            const detail::shared_dataset_source& source)
+        {
+            if (source.path == path && util::shared_memory::unlink(name)) {
+                removed++;
+            }
+        });
+        return removed;
+    }
+
+    // Attaches read-only to the dataset of the file filename that has been
+    // published under key, which has to identify the way it is loaded. If
+    // there is none yet, this process calls load(writer) and publishes the
+    // dataset afterwards. load calls writer.allocate(rows, rank) once and
+    // then writer.push_back(features, label) for every row, whose features
+    // are encoded with E straight into the segment. Processes that start
+    // while it is loading wait for it instead of loading the file again. A
+    // segment whose creator died before publishing is replaced.
+    //
+    // The segment is removed from /dev/shm when the last process that uses
+    // it detaches. If that process dies without detaching, the segment
+    // stays until the next process that uses it detaches. With persistent,
+    // the process that
+    // loads the dataset keeps the segment in /dev/shm after all processes
+    // have exited instead, so that later runs start without loading.
+    // Segments of earlier contents of the file, with another identity, are
+    // removed when the dataset is shared again. unshare_dataset removes all
+    // of them, e.g. once the memory is needed or the file changed in place
+    // without a new modification time.
+    template<class E, class T = double, class Load>
+    auto share_dataset(const std::string& filename, const std::string& key,
+        Load&& load, bool persistent = false,
+        std::chrono::milliseconds poll_interval = std::chrono::milliseconds{50})
+        -> shared_dataset<E, T>
+    {
+        using namespace detail;
+
+        auto path = canonical_path(filename);
+        auto identity = file_identity(filename);
+        for_each_shared_dataset([&](const std::string& name,
+            const shared_dataset_source& source)
+        {
+            if (source.path == path && source.identity != identity) {
+                try {
+                    util::shared_memory::unlink(name);
+                } catch (const std::runtime_error&) {
+                    // e.g. a segment of another user, which is kept
+                }
+            }
+        });
+
+        auto name = shared_dataset_name(path, identity, key);
+        // Waiting time for a segment whose creator hasn't written its
+        // header yet, after which the creator is assumed to be dead.
+        auto header_timeout = std::chrono::seconds{10};
+        auto empty_since = std::chrono::steady_clock::time_point{};
+        auto empty = false;
+        while (true) {
+            auto opened = util::shared_memory::open(name);
+            if (opened && opened->size() >= sizeof(shared_dataset_header)) {
+                auto& published = *static_cast<const shared_dataset_header*>(
+                    opened->data());
+                if (published.ready.load(std::memory_order_acquire) != 0
+                    && published.persistent == 0
+                    && !opened->remove_when_unused(name)) {
+                    // removed by its last user in the meantime
+                    continue;
+                }
+            }
+            auto segment = std::shared_ptr<const util::shared_memory>{
+                std::move(opened)};
+            if (segment && segment->size() >= sizeof(shared_dataset_header)) {
+                if (auto result = attach_shared<E, T>(segment, key)) {
+                    return std::move(*result);
+                }
+                auto& header = *static_cast<const shared_dataset_header*>(
+                    segment->data());
+                if (header.ready.load(std::memory_order_acquire) == 0
+                    && !process_exists(header.creator)) {
+                    util::shared_memory::unlink(name);
+                    continue;
+                }
+                empty = false;
+            } else if (segment) {
+                auto now = std::chrono::steady_clock::now();
+                if (!empty) {
+                    empty = true;
+                    empty_since = now;
+                } else if (now - empty_since > header_timeout) {
+                    util::shared_memory::unlink(name);
+                    empty = false;
+                    continue;
+                }
+            } else if (auto created = util::shared_memory::create(
+                    name, sizeof(shared_dataset_header))) {
+                // This process claimed the name, the others wait until the
+                // dataset is published.
+                try {
+                    {
+                        auto header = new (created->data())
+                            shared_dataset_header{};
+                        header->creator = static_cast<int32_t>(::getpid());
+                        header->persistent = persistent ? 1 : 0;
+                        header->key_size = key.size();
+                        header->path_size = path.size();
+                        header->identity_size = identity.size();
+                        created->resize(
+                            shared_dataset_layout{*header}.features);
+                    }
+                    auto bytes = static_cast<char*>(created->data());
+                    auto& header =
+                        *reinterpret_cast<shared_dataset_header*>(bytes);
+                    auto layout = shared_dataset_layout{header};
+                    std::memcpy(bytes + layout.key, key.data(), key.size());
+                    std::memcpy(bytes + layout.path, path.data(), path.size());
+                    std::memcpy(bytes + layout.identity, identity.data(),
+                        identity.size());
+                    std::atomic_thread_fence(std::memory_order_release);
+                    std::memcpy(header.magic, shared_dataset_magic,
+                        sizeof(header.magic));
+
+                    if (!persistent) {
+                        created->remove_when_unused(name);
+                    }
+                    auto writer = shared_dataset_writer<E, T>{*created};
+                    load(writer);
+                    writer.publish();
+                    created->protect();
+                } catch (...) {
+                    util::shared_memory::unlink(name);
+                    throw;
+                }
+                auto result = attach_shared<E, T>(
+                    std::shared_ptr<const util::shared_memory>{
+                        std::move(created)}, key);
+                result->attached = false;
+                return std::move(*result);
+            } else {
+                // created by another process in the meantime
+                continue;
+            }
+            std::this_thread::sleep_for(poll_interval);
+        }
+    }
+
+} // namespace ldnn
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "ldnn/vector.hpp"
+
+namespace ldnn {
+
+    // A sparse vector of the given rank that refers to its non-zero entries:
+    // value[k] is the entry at dimension index[k], indices are ascending.
+    // The entries are owned by a sparse_matrix.
+    template<class T = double>
+    struct sparse_row {
+        using value_type = T;
+
+        sparse_row(rank_t rank, const uint32_t* index, const T* value,
+            size_t nnz)
+            : index(index), value(value), nnz(nnz), rank_(rank)
+        {}
+
+        auto rank() const noexcept
+            -> rank_t
+        {
+            return rank_;
+        }
+
+        const uint32_t* index;
+        const T* value;
+        size_t nnz;
+
+    private:
+        rank_t rank_;
+    };
+
+    // Sparse vectors of the same rank in compressed sparse row format.
+    template<class T = double>
+    class sparse_matrix {
+    public:
+        sparse_matrix() = default;
+
+        explicit sparse_matrix(rank_t rank)
+            : rank_(rank)
+        {}
+
+        // Appends a row from its (index, value) entries. Zero values are
+        // dropped, the entries don't have to be sorted.
+        void push_back(std::vector<std::pair<uint32_t, T>> entries) {
+            std::sort(begin(entries), end(entries),
+                [](auto& l, auto& r) { return l.first < r.first; });
+            for (auto k : indices(entries.size())) {
+                if (k > 0 && entries[k].first == entries[k - 1].first) {
+                    throw std::invalid_argument{"duplicate index in row"};
+                }
+                if (entries[k].second != T{0}) {
+                    index.push_back(entries[k].first);
+                    value.push_back(entries[k].second);
+                }
+            }
+            if (entries.size() > 0) {
+                rank_.value = std::max<size_t>(
+                    rank_.value, entries.back().first + size_t{1});
+            }
+            row_begin.push_back(index.size());
+        }
+
+        auto operator[](size_t i) const
+            -> sparse_row<T>
+        {
+            return {rank_, index.data() + row_begin[i],
+                value.data() + row_begin[i], row_begin[i + 1] - row_begin[i]};
+        }
+
+        // Number of rows.
+        auto size() const
+            -> size_t
+        {
+            return row_begin.size() - 1;
+        }
+
+        // The rank of all rows, which is at least one more than the largest
+        // index of any row.
+        auto rank() const
+            -> rank_t
+        {
+            return rank_;
+        }
+
+        void set_rank(rank_t rank) {
+            if (rank < rank_) {
+                throw std::invalid_argument{"rank too small for the entries"};
+            }
+            rank_ = rank;
+        }
+
+        // Total number of non-zero entries.
+        auto nnz() const
+            -> size_t
+        {
+            return value.size();
+        }
+
+        // Divides every column by its maximum absolute value, so that all
+        // entries are in [-1, 1]. Unlike min-max scaling, this keeps zeros.
+        void max_abs_scale() {
+            auto max = std::vector<T>(rank_.value, T{0});
+            for (auto k : indices(value.size())) {
+                max[index[k]] = std::max(max[index[k]], std::abs(value[k]));
+            }
+            for (auto k : indices(value.size())) {
+                value[k] /= max[index[k]];
+            }
+        }
+
+    private:
+        rank_t rank_ = {0};
+        std::vector<size_t> row_begin = {0};
+        std::vector<uint32_t> index;
+        std::vector<T> value;
+    };
+
+    // Dot product in O(nnz).
+    template<class T, class A>
+    auto operator*(const vector<T, A>& l, const sparse_row<T>& r)
+        -> T
+    {
+        if (l.rank() != r.rank())
+            throw std::invalid_argument{"rank differs"};
+
+        auto sum = T{0};
+        for (auto k : indices(r.nnz)) {
+            sum += l[r.index[k]] * r.value[k];
+        }
+        return sum;
+    }
+
+    template<class T, class A>
+    auto operator*(const sparse_row<T>& l, const vector<T, A>& r)
+        -> T
+    {
+        return r * l;
+    }
+
+    template<class T, class A>
+    auto operator+=(vector<T, A>& l, const sparse_row<T>& r)
+        -> vector<T, A>&
+    {
+        if (l.rank() != r.rank())
+            throw std::invalid_argument{"rank differs"};
+
+        for (auto k : indices(r.nnz)) {
+            l[r.index[k]] += r.value[k];
+        }
+        return l;
+    }
+
+    template<class T>
+    auto to_dense(const sparse_row<T>& v)
+        -> vector<T>
+    {
+        auto result = vector<T>{v.rank()};
+        for (auto k : indices(v.nnz)) {
+            result[v.index[k]] = v.value[k];
+        }
+        return result;
+    }
+
+} // namespace ldnn
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <numeric>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "util/random.hpp"
+#include "util/thread_pool.hpp"
+
+#include "network.hpp"
+
+namespace ldnn {
+
+// Parses a list of numbers of the form [a,b,c].
+template<class U>
+auto parse_list(const std::string& str)
+    -> std::vector<U>
+{
+    auto result = std::vector<U>{};
+    auto lnstr = std::stringstream{str};
+    for (auto word = std::string{}; std::getline(lnstr, word, ','); ) {
+        word.erase(std::remove_if(begin(word), end(word), [](char c) {
+            return c == '[' || c == ']' || std::isspace(c);
+        }), end(word));
+        if (word.size() > 0) {
+            result.push_back(static_cast<U>(std::stod(word)));
+        }
+    }
+    return result;
+}
+
+// Ids of the random streams of a sweep.
+enum sweep_stream : uint64_t {
+    sweep_configs, sweep_folds, sweep_centroids, sweep_training
+};
+
+// The network parameters to evaluate in a hyperparameter sweep, read from
+// the [sweep] section of an ini file.
+template<class T = double>
+struct sweep_spec {
+    using network_config_t = typename network<T>::config_t;
+
+    // Candidate values of the swept network parameters. An empty list
+    // keeps the value of the base config.
+    std::vector<size_t> polytope_count;
+    std::vector<size_t> max_halfspaces;
+    std::vector<T> alpha;
+    std::vector<size_t> kmeans_iterations;
+
+    // Whether to draw samples configurations at random from the candidate
+    // values instead of evaluating the full grid.
+    bool random;
+    size_t samples;
+
+    // Number of cross validation folds per configuration.
+    size_t folds;
+
+    // Seed of the random configurations, the fold partitioning, k-means and
+    // the training order.
+    uint64_t seed;
+
+    // Name of the file the results table is written to.
+    std::string output;
+
+    static sweep_spec read(const std::string& filename) {
+        auto ini_config = INIReader{filename};
+        if (ini_config.ParseError() < 0) {
+            throw std::invalid_argument{
+                filename + " couldn't be opened or parsed!"};
+        }
+        auto spec = sweep_spec{};
+
+        spec.polytope_count = parse_list<size_t>(
+            ini_config.Get("sweep", "polytope_count", ""));
+        spec.max_halfspaces = parse_list<size_t>(
+            ini_config.Get("sweep", "max_halfspaces", ""));
+        spec.alpha = parse_list<T>(ini_config.Get("sweep", "alpha", ""));
+        spec.kmeans_iterations = parse_list<size_t>(
+            ini_config.Get("sweep", "kmeans_iterations", ""));
+
+        auto mode = ini_config.Get("sweep", "mode", "grid");
+        if (mode != "grid" && mode != "random") {
+            throw std::invalid_argument{"The value " + mode
+                + " is not valid for parameter sweep.mode!"};
+        }
+        spec.random = mode == "random";
+        spec.samples = static_cast<size_t>(
+            ini_config.GetInteger("sweep", "samples", 10));
+        spec.folds = static_cast<size_t>(
+            ini_config.GetInteger("sweep", "folds", 2));
+        if (spec.folds < 2) {
+            throw std::invalid_argument{"sweep.folds has to be at least 2"};
+        }
+        spec.seed = std::stoull(ini_config.Get("sweep", "seed", "0"));
+        spec.output = ini_config.Get("sweep", "output", "sweep.tsv");
+
+        return spec;
+    }
+
+    // Returns the configurations to evaluate, based on base.
+    auto configs(const network_config_t& base) const
+        -> std::vector<network_config_t>
+    {
+        auto or_base = [](auto values, auto value) {
+            if (values.size() == 0) {
+                values.push_back(value);
+            }
+            return values;
+        };
+        auto pc = or_base(polytope_count, base.polytope_count);
+        auto mh = or_base(max_halfspaces, base.max_halfspaces);
+        auto al = or_base(alpha, base.alpha);
+        auto ki = or_base(kmeans_iterations, base.kmeans_iterations);
+
+        auto result = std::vector<network_config_t>{};
+        auto add = [&](size_t a, size_t b, size_t c, size_t d) {
+            auto config = base;
+            config.polytope_count = pc[a];
+            config.max_halfspaces = mh[b];
+            config.alpha = al[c];
+            config.kmeans_iterations = ki[d];
+            result.push_back(config);
+        };
+        if (random) {
+            auto gen = util::philox4x32{seed}.stream(sweep_configs);
+            auto pick = [&](auto& values) {
+                return std::uniform_int_distribution<size_t>{
+                    0, values.size() - 1}(gen);
+            };
+            for (auto remaining = samples; remaining-- > 0; ) {
+                add(pick(pc), pick(mh), pick(al), pick(ki));
+            }
+        } else {
+            for (auto a : indices(pc.size()))
+                for (auto b : indices(mh.size()))
+                    for (auto c : indices(al.size()))
+                        for (auto d : indices(ki.size()))
+                            add(a, b, c, d);
+        }
+        return result;
+    }
+};
+
+template<class T = double>
+struct sweep_result {
+    typename network<T>::config_t config;
+
+    // Mean accuracy over all folds.
+    double accuracy;
+
+    // Total time spent on the folds of this configuration.
+    std::chrono::milliseconds time;
+};
+
+// The k-means centroids of the positive or negative examples of the folds
+// of a sweep. They only depend on (k, iterations, fold, positive) and the
+// random stream, so configurations that share these values share them.
+template<class T = double>
+class centroid_cache {
+public:
+    using key_type = std::tuple<size_t, size_t, size_t, bool>;
+
+    explicit centroid_cache(util::philox4x32 rng) : rng(rng) {}
+
+    // Requests the centroids of a key, they are computed by compute_all.
+    void request(size_t k, size_t iterations, size_t fold, bool positive) {
+        entries.emplace(key_type{k, iterations, fold, positive},
+            std::vector<vector<T>>{});
+    }
+
+    // Computes the centroids of all requested keys as tasks of pool, with
+    // compute(k, iterations, fold, positive, gen). gen is the substream of
+    // the key. The centroids are computed before any job that uses them is
+    // started, so no task of the pool waits for another one.
+    template<class Compute>
+    void compute_all(util::thread_pool& pool, Compute&& compute) {
+        auto jobs = std::vector<std::future<std::vector<vector<T>>>>{};
+        for (auto& entry : entries) {
+            auto key = entry.first;
+            jobs.push_back(pool.submit([&, key] {
+                auto gen = rng.stream(std::get<0>(key), std::get<1>(key),
+                    std::get<2>(key), std::get<3>(key));
+                return compute(std::get<0>(key), std::get<1>(key),
+                    std::get<2>(key), std::get<3>(key), gen);
+            }));
+        }
+
+        // Wait for all jobs before the first error may leave this scope.
+        for (auto& job : jobs) {
+            job.wait();
+        }
+        auto job = begin(jobs);
+        for (auto& entry : entries) {
+            entry.second = (job++)->get();
+        }
+    }
+
+    auto get(size_t k, size_t iterations, size_t fold, bool positive) const
+        -> const std::vector<vector<T>>&
+    {
+        return entries.at(key_type{k, iterations, fold, positive});
+    }
+
+private:
+    util::philox4x32 rng;
+    std::map<key_type, std::vector<vector<T>>> entries;
+};
+
+// Evaluates every configuration of spec with k-fold cross validation. All
+// (configuration x fold) jobs share examples and are scheduled on pool.
+template<class T>
+auto run_sweep(const sweep_spec<T>& spec,
+    const typename network<T>::config_t& base,
+    const std::vector<typename network<T>::classification>& examples,
+    size_t epochs, util::thread_pool& pool)
+    -> std::vector<sweep_result<T>>
+{
+    if (examples.size() < spec.folds) {
+        throw std::invalid_argument{"fewer examples than folds"};
+    }
+
+    // Partition the examples into folds.
+    auto order = std::vector<size_t>(examples.size());
+    std::iota(begin(order), end(order), size_t{0});
+    auto rng = util::philox4x32{spec.seed};
+    util::shuffle(order, rng.stream(sweep_folds));
+    auto fold_begin = [&](size_t fold) {
+        return begin(order) + fold * order.size() / spec.folds;
+    };
+
+    auto configs = spec.configs(base);
+    auto training_rows = [&](size_t fold) {
+        auto train = std::vector<size_t>(begin(order), fold_begin(fold));
+        train.insert(end(train), fold_begin(fold + 1), end(order));
+        return train;
+    };
+
+    // The centroids are shared by all configurations with the same k,
+    // kmeans_iterations and fold.
+    centroid_cache<T> cache{rng.stream(sweep_centroids)};
+    for (auto& config : configs) {
+        for (auto fold : indices(spec.folds)) {
+            cache.request(config.polytope_count, config.kmeans_iterations,
+                fold, true);
+            cache.request(config.max_halfspaces, config.kmeans_iterations,
+                fold, false);
+        }
+    }
+    cache.compute_all(pool, [&](size_t k, size_t iterations, size_t fold,
+        bool positive, auto& gen)
+    {
+        auto rows = std::vector<size_t>{};
+        for (auto i : training_rows(fold)) {
+            if (examples[i].positive == positive) {
+                rows.push_back(i);
+            }
+        }
+        return network<T>::kmeans(examples, std::move(rows), k, gen,
+            iterations);
+    });
+
+    auto jobs = std::vector<std::future<std::pair<size_t, std::chrono::milliseconds>>>{};
+    for (auto c : indices(configs.size())) {
+        for (auto fold : indices(spec.folds)) {
+            jobs.push_back(pool.submit([&, c, fold] {
+                auto start_time = std::chrono::steady_clock::now();
+                auto& config = configs[c];
+                auto train = training_rows(fold);
+                auto net = network<T>{config,
+                    cache.get(config.polytope_count,
+                        config.kmeans_iterations, fold, true),
+                    cache.get(config.max_halfspaces,
+                        config.kmeans_iterations, fold, false)};
+
+                auto gen = rng.stream(sweep_training, c, fold);
+                for (auto remaining = epochs; remaining-- > 0; ) {
+                    util::shuffle(train, gen);
+                    for (auto i : train) {
+                        net.gradient_descent(examples[i]);
+                    }
+                    net.next_epoch();
+                }
+
+                auto correct = size_t{0};
+                std::for_each(fold_begin(fold), fold_begin(fold + 1),
+                    [&](auto i) {
+                        if ((net.classify(examples[i].vec) > 0.5)
+                            == examples[i].positive) {
+                            correct++;
+                        }
+                    });
+                return std::make_pair(correct,
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start_time));
+            }));
+        }
+    }
+
+    // Wait for all jobs before the first error may leave this scope.
+    for (auto& job : jobs) {
+        job.wait();
+    }
+
+    auto results = std::vector<sweep_result<T>>{};
+    for (auto c : indices(configs.size())) {
+        auto correct = size_t{0};
+        auto time = std::chrono::milliseconds{0};
+        for (auto fold : indices(spec.folds)) {
+            auto job = jobs[c * spec.folds + fold].get();
+            correct += job.first;
+            time += job.second;
+        }
+        results.push_back({configs[c],
+            static_cast<double>(correct) / examples.size(), time});
+    }
+    return results;
+}
+
+template<class T>
+void write_sweep_results(std::ostream& o,
+    const std::vector<sweep_result<T>>& results)
+{
+    o << "polytope_count\tmax_halfspaces\talpha\tkmeans_iterations"
+      << "\taccuracy\ttime_ms\n";
+    for (auto& r : results) {
+        o << r.config.polytope_count << "\t" << r.config.max_halfspaces
+          << "\t" << r.config.alpha << "\t" << r.config.kmeans_iterations
+          << "\t" << r.accuracy << "\t" << r.time.count() << "\n";
+    }
+}
+
+} // namespace ldnn
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "util/algorithm.hpp"
+#include "util/arena.hpp"
 #include "util/indices.hpp"
 #include "util/iterator/ostream_joiner.hpp"
 
@@ -60,39 +61,59 @@ auto indices<ldnn::rank_t>(ldnn::rank_t last)
 
 namespace ldnn {
 
-    template<class T = double>
+    template<class T = double, class Allocator = std::allocator<T>>
     struct vector {
         static_assert(std::is_floating_point<T>::value,
             "T has to be a floating-point type");
 
         using value_type = T;
+        using allocator_type = Allocator;
         using reference = T&;
         using const_reference = T const&;
 
         vector() = default;
 
-        vector(rank_t rank)
-            : vector(rank, 0)
+        explicit vector(const Allocator& alloc)
+            : data(alloc)
         {}
 
-        vector(rank_t rank, value_type initial_value) {
-            data.resize(rank.value);
-            util::fill(data, initial_value);
-        }
+        vector(rank_t rank, const Allocator& alloc = Allocator{})
+            : vector(rank, 0, alloc)
+        {}
 
-        vector(const std::vector<T>& init) : data(init) {}
-        vector(std::vector<T>&& init) : data(std::move(init)) {}
+        vector(rank_t rank, value_type initial_value,
+            const Allocator& alloc = Allocator{})
+            : data(rank.value, initial_value, alloc)
+        {}
+
+        vector(const std::vector<T>& init)
+            : data(init.begin(), init.end())
+        {}
+        vector(std::vector<T, Allocator>&& init) : data(std::move(init)) {}
 
         vector(std::initializer_list<value_type> init)
             : data(init)
         {}
 
+        // Copies a vector that uses a different allocator.
+        template<class OtherAllocator>
+        explicit vector(const vector<T, OtherAllocator>& other,
+            const Allocator& alloc = Allocator{})
+            : data(other.begin(), other.end(), alloc)
+        {}
+
         vector(vector const&) = default;
         vector(vector&&) = default;
 
         vector& operator=(vector const&) = default;
         vector& operator=(vector&&) = default;
 
+        auto get_allocator() const
+            -> allocator_type
+        {
+            return data.get_allocator();
+        }
+
         auto begin() noexcept
             -> decltype(auto)
         {
@@ -148,11 +169,16 @@ namespace ldnn {
         }
 
     private:
-        std::vector<T> data;
+        std::vector<T, Allocator> data;
     };
 
-    template<class T>
-    auto operator<<(std::ostream& o, const vector<T>& v)
+    // A vector for temporary values that allocates from the arena of the
+    // calling thread, see util::arena.
+    template<class T = double>
+    using scratch_vector = vector<T, util::arena_allocator<T>>;
+
+    template<class T, class A>
+    auto operator<<(std::ostream& o, const vector<T, A>& v)
         -> std::ostream&
     {
         o << "(";
@@ -160,41 +186,45 @@ namespace ldnn {
         return o << ")";
     }
 
-    template<class T, class U,
+    template<class T, class A, class U,
         class = typename std::enable_if<std::is_arithmetic<U>::value>::type>
-    auto scale(const vector<T>& vec, U scale)
-        -> vector<T>
+    auto scale(const vector<T, A>& vec, U scale)
+        -> vector<T, A>
     {
-        auto result = vector<T>{vec.rank()};
+        auto result = vector<T, A>{vec.rank(), vec.get_allocator()};
         util::transform(vec, result.begin(), util::multiply_by(scale));
         return result;
     }
 
-    template<class T>
-    auto length(const vector<T>& vec)
-        -> typename vector<T>::value_type
+    template<class T, class A>
+    auto length(const vector<T, A>& vec)
+        -> typename vector<T, A>::value_type
     {
         auto sum = T{0};
         util::for_each(vec, [&](auto& e) { sum += util::square(e); });
         return std::sqrt(sum);
     }
 
-    template<class T>
-    auto normalize(const vector<T>& vec)
-        -> vector<T>
+    template<class T, class A>
+    auto normalize(const vector<T, A>& vec)
+        -> vector<T, A>
     {
         return scale(vec, T{1} / length(vec));
     }
 
     namespace detail {
 
-        template<class T, class U, class Fn>
-        auto vector_merge(const vector<T>& l, const vector<U>& r, Fn&& fn)
+        template<class T, class A, class U, class B, class Fn>
+        auto vector_merge(const vector<T, A>& l, const vector<U, B>& r, Fn&& fn)
         {
             if (l.rank() != r.rank())
                 throw std::invalid_argument{"rank differs"};
 
-            auto result = vector<decltype(fn(l[0], r[0]))>{l.rank()};
+            using result_type = decltype(fn(l[0], r[0]));
+            using allocator_type = typename std::allocator_traits<A>
+                ::template rebind_alloc<result_type>;
+            auto result = vector<result_type, allocator_type>{
+                l.rank(), allocator_type{l.get_allocator()}};
             for (auto i : indices(result.rank())) {
                 result[i] = fn(l[i], r[i]);
             }
@@ -202,10 +232,25 @@ namespace ldnn {
             return result;
         }
 
+        // Applies fn(l[i], r[i]) to every element of l in place.
+        template<class T, class A, class U, class B, class Fn>
+        auto vector_apply(vector<T, A>& l, const vector<U, B>& r, Fn&& fn)
+            -> vector<T, A>&
+        {
+            if (l.rank() != r.rank())
+                throw std::invalid_argument{"rank differs"};
+
+            for (auto i : indices(l.rank())) {
+                fn(l[i], r[i]);
+            }
+
+            return l;
+        }
+
     } // namespace detail
 
-    template<class T, class U>
-    auto operator==(const vector<T>& l, const vector<U>& r)
+    template<class T, class A, class U, class B>
+    auto operator==(const vector<T, A>& l, const vector<U, B>& r)
         -> bool
     {
         if (l.rank() != r.rank())
@@ -216,65 +261,105 @@ namespace ldnn {
         return equal;
     }
 
-    template<class T, class U>
-    auto operator!=(const vector<T>& l, const vector<U>& r)
+    template<class T, class A, class U, class B>
+    auto operator!=(const vector<T, A>& l, const vector<U, B>& r)
         -> bool
     {
         return !(l == r);
     }
 
-    template<class T, class U>
-    auto operator*(const vector<T>& l, const vector<U>& r)
+    template<class T, class A, class U, class B>
+    auto operator*(const vector<T, A>& l, const vector<U, B>& r)
         -> decltype(l[0] * r[0])
     {
-        auto _tmp = detail::vector_merge(l, r,
-            [](auto a, auto b) { return a * b; });
-        return util::accumulate(_tmp, T{0});
+        if (l.rank() != r.rank())
+            throw std::invalid_argument{"rank differs"};
+
+        return std::inner_product(l.begin(), l.end(), r.begin(),
+            decltype(l[0] * r[0]){0});
     }
 
-    template<class T, class U,
+    template<class T, class A, class U,
         class = typename std::enable_if<std::is_arithmetic<U>::value>::type>
-    auto operator*(const vector<T>& l, U r)
-        -> vector<T>
+    auto operator*(const vector<T, A>& l, U r)
+        -> vector<T, A>
     {
         return scale(l, r);
     }
 
-    template<class T, class U,
+    template<class T, class A, class U,
         class = typename std::enable_if<std::is_arithmetic<U>::value>::type>
-    auto operator*(U r, const vector<T>& l)
-        -> vector<T>
+    auto operator*(U r, const vector<T, A>& l)
+        -> vector<T, A>
     {
         return l * r;
     }
 
-    template<class T, class U,
+    template<class T, class A, class U,
         class = typename std::enable_if<std::is_arithmetic<U>::value>::type>
-    auto operator/(const vector<T>& l, U r)
-        -> vector<T>
+    auto operator/(const vector<T, A>& l, U r)
+        -> vector<T, A>
     {
         return scale(l, U{1} / r);
     }
 
-    template<class T, class U>
-    auto operator+(const vector<T>& l, const vector<U>& r)
-        -> vector<decltype(l[0] + r[0])>
+    template<class T, class A, class U, class B>
+    auto operator+(const vector<T, A>& l, const vector<U, B>& r)
+        -> vector<decltype(l[0] + r[0]), A>
     {
         return detail::vector_merge(l, r, [](auto a, auto b) { return a + b; });
     }
 
-    template<class T, class U>
-    auto operator-(const vector<T>& l, const vector<U>& r)
-        -> vector<decltype(l[0] - r[0])>
+    template<class T, class A, class U, class B>
+    auto operator-(const vector<T, A>& l, const vector<U, B>& r)
+        -> vector<decltype(l[0] - r[0]), A>
     {
         return detail::vector_merge(l, r, [](auto a, auto b) { return a - b; });
     }
 
-    template<class T, class U>
-    auto distance(const vector<T>& l, const vector<U>& r)
-        -> decltype(length(l - r))
+    template<class T, class A, class U, class B>
+    auto operator+=(vector<T, A>& l, const vector<U, B>& r)
+        -> vector<T, A>&
+    {
+        return detail::vector_apply(l, r, [](auto& a, auto b) { a += b; });
+    }
+
+    template<class T, class A, class U, class B>
+    auto operator-=(vector<T, A>& l, const vector<U, B>& r)
+        -> vector<T, A>&
     {
-        return length(l - r);
+        return detail::vector_apply(l, r, [](auto& a, auto b) { a -= b; });
+    }
+
+    template<class T, class A, class U,
+        class = typename std::enable_if<std::is_arithmetic<U>::value>::type>
+    auto operator*=(vector<T, A>& l, U r)
+        -> vector<T, A>&
+    {
+        util::for_each(l, [&](auto& e) { e *= r; });
+        return l;
+    }
+
+    template<class T, class A, class U,
+        class = typename std::enable_if<std::is_arithmetic<U>::value>::type>
+    auto operator/=(vector<T, A>& l, U r)
+        -> vector<T, A>&
+    {
+        return l *= U{1} / r;
+    }
+
+    template<class T, class A, class U, class B>
+    auto distance(const vector<T, A>& l, const vector<U, B>& r)
+        -> decltype(l[0] - r[0])
+    {
+        if (l.rank() != r.rank())
+            throw std::invalid_argument{"rank differs"};
+
+        auto sum = decltype(l[0] - r[0]){0};
+        for (auto i : indices(l.rank())) {
+            sum += util::square(l[i] - r[i]);
+        }
+        return std::sqrt(sum);
     }
 
     template<class InputIterator>
@@ -285,9 +370,9 @@ namespace ldnn {
 
         using value_type =
             typename std::iterator_traits<InputIterator>::value_type;
-        auto zero = value_type{(*first).rank()};
-        return std::accumulate(first, last, zero)
-            / static_cast<double>(std::distance(first, last));
+        auto sum = value_type{(*first).rank()};
+        std::for_each(first, last, [&](auto& v) { sum += v; });
+        return sum /= static_cast<double>(std::distance(first, last));
     }
 
     template<class InputRange>
@@ -295,56 +380,58 @@ namespace ldnn {
         return centroid(std::begin(r), std::end(r));
     }
 
-    template<class T, class IdxRange,
+    template<class T, class A, class IdxRange,
         class = typename std::enable_if<
             std::is_integral<typename std::decay<IdxRange>::type::value_type>::value
         >::type
     >
-    auto select_dimensions(const vector<T>& vec, IdxRange&& dims)
-        -> vector<T>
+    auto select_dimensions(const vector<T, A>& vec, IdxRange&& dims)
+        -> vector<T, A>
     {
-        auto elems = std::vector<T>{};
-        util::transform(dims, std::back_inserter(elems),
+        auto result = vector<T, A>{
+            rank_t{static_cast<size_t>(util::size(dims))}, vec.get_allocator()};
+        util::transform(dims, result.begin(),
             [&](auto& dim) { return vec[dim]; });
-        return vector<T>{elems};
+        return result;
     }
 
-    template<class T, class I>
-    auto select_dimensions(const vector<T>& vec, std::initializer_list<I> dims)
-        -> vector<T>
+    template<class T, class A, class I>
+    auto select_dimensions(const vector<T, A>& vec, std::initializer_list<I> dims)
+        -> vector<T, A>
     {
         return select_dimensions(vec, std::vector<I>(dims));
     }
 
-    template<class T, class IdxRange,
+    template<class T, class A, class IdxRange,
         class = typename std::enable_if<
             std::is_integral<typename std::decay<IdxRange>::type::value_type>::value
         >::type
     >
-    auto select_dimensions(const std::vector<vector<T>>& vecs, IdxRange&& dims)
+    auto select_dimensions(const std::vector<vector<T, A>>& vecs, IdxRange&& dims)
     {
-        auto result = std::vector<vector<T>>{};
+        auto result = std::vector<vector<T, A>>{};
         util::transform(vecs, std::back_inserter(result),
             [&](auto& vec) { return select_dimensions(vec, dims); });
         return result;
     }
 
-    template<class T, class I>
-    auto select_dimensions(const std::vector<vector<T>>& vecs,
+    template<class T, class A, class I>
+    auto select_dimensions(const std::vector<vector<T, A>>& vecs,
         std::initializer_list<I> dims)
     {
         return select_dimensions(vecs, std::vector<I>(dims));
     }
 
-    template<class T, class Idx>
-    auto remove_dimension(const vector<T>& vec, Idx dim)
-        -> vector<T>
+    template<class T, class A, class Idx>
+    auto remove_dimension(const vector<T, A>& vec, Idx dim)
+        -> vector<T, A>
     {
         if (dim < 0 || dim > vec.rank().value) {
             throw std::invalid_argument{"dimension out of range"};
         }
 
-        auto result = vector<T>{rank_t{vec.rank().value - 1}};
+        auto result = vector<T, A>{
+            rank_t{vec.rank().value - 1}, vec.get_allocator()};
         for (auto i = Idx{0}, j = Idx{0}; i < vec.rank(); ++i) {
             if (i == dim) {
                 continue;
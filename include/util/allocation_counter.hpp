@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+namespace util {
+
+    // Whether global allocations are counted, see LDNN_COUNT_ALLOCATIONS.
+#ifdef LDNN_COUNT_ALLOCATIONS
+    constexpr bool counting_allocations = true;
+#else
+    constexpr bool counting_allocations = false;
+#endif
+
+    // Returns the number of calls to the global operator new so far, or 0
+    // if allocations are not counted.
+    auto allocation_count()
+        -> size_t;
+
+} // namespace util
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace util {
+
+    // A bump allocator: memory is carved out of large blocks and only
+    // released all at once by rewinding the arena to an earlier mark. The
+    // blocks are kept, so an arena that is rewound regularly stops calling
+    // the global allocator after warming up.
+    class arena {
+    public:
+        struct marker {
+            size_t block;
+            size_t offset;
+        };
+
+        // Rewinds the given arena to its state at construction when it goes
+        // out of scope.
+        class scope {
+        public:
+            explicit scope(arena& a = arena::local())
+                : a(a), m(a.mark())
+            {}
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+
+            ~scope() {
+                a.rewind(m);
+            }
+
+        private:
+            arena& a;
+            marker m;
+        };
+
+    public:
+        explicit arena(size_t block_size = size_t{1} << 20)
+            : block_size(block_size)
+        {}
+
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        auto allocate(size_t size, size_t alignment)
+            -> void*
+        {
+            if (blocks.size() > 0) {
+                auto offset = align(current_offset, alignment);
+                if (offset + size <= blocks[current].size) {
+                    current_offset = offset + size;
+                    return blocks[current].data.get() + offset;
+                }
+            }
+
+            // Continue with the next block that is large enough, or insert a
+            // new one after the current block.
+            auto next = blocks.size() > 0 ? current + 1 : 0;
+            while (next < blocks.size() && blocks[next].size < size + alignment) {
+                next++;
+            }
+            if (next == blocks.size()) {
+                next = blocks.size() > 0 ? current + 1 : 0;
+                auto block_bytes = std::max(block_size, size + alignment);
+                blocks.insert(begin(blocks) + next,
+                    block{std::unique_ptr<char[]>{new char[block_bytes]},
+                        block_bytes});
+            }
+            current = next;
+            current_offset = align(0, alignment);
+            auto ptr = blocks[current].data.get() + current_offset;
+            current_offset += size;
+            return ptr;
+        }
+
+        auto mark() const
+            -> marker
+        {
+            return {current, current_offset};
+        }
+
+        // Releases everything that has been allocated after m was taken.
+        void rewind(marker m) {
+            current = m.block;
+            current_offset = m.offset;
+        }
+
+        // Releases all allocations.
+        void reset() {
+            rewind({0, 0});
+        }
+
+        // The arena of the calling thread.
+        static auto local()
+            -> arena&
+        {
+            static thread_local arena instance;
+            return instance;
+        }
+
+    private:
+        struct block {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        auto align(size_t offset, size_t alignment) const
+            -> size_t
+        {
+            auto address = reinterpret_cast<std::uintptr_t>(
+                blocks[current].data.get()) + offset;
+            return offset + (alignment - address % alignment) % alignment;
+        }
+
+    private:
+        size_t block_size;
+        std::vector<block> blocks;
+        size_t current = 0;
+        size_t current_offset = 0;
+    };
+
+    // Allocates from the arena of the calling thread. Deallocation is a
+    // no-op, the memory is reclaimed by rewinding the arena.
+    template<class T>
+    struct arena_allocator {
+        using value_type = T;
+
+        arena_allocator() noexcept = default;
+
+        template<class U>
+        arena_allocator(const arena_allocator<U>&) noexcept {}
+
+        auto allocate(size_t n)
+            -> T*
+        {
+            return static_cast<T*>(
+                arena::local().allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T*, size_t) noexcept {}
+    };
+
+    template<class T, class U>
+    auto operator==(const arena_allocator<T>&, const arena_allocator<U>&)
+        -> bool
+    {
+        return true;
+    }
+
+    template<class T, class U>
+    auto operator!=(const arena_allocator<T>&, const arena_allocator<U>&)
+        -> bool
+    {
+        return false;
+    }
+
+} // namespace util
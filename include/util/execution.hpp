@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "algorithm.hpp"
+#include "thread_pool.hpp"
+
+namespace util {
+
+    // Returns the number of threads of the default pool. It can be changed
+    // until default_pool is called for the first time; 0 uses the number of
+    // hardware threads.
+    inline auto default_concurrency()
+        -> size_t&
+    {
+        static auto concurrency = size_t{0};
+        return concurrency;
+    }
+
+    // The pool shared by all parallel algorithms and stages, unless a
+    // policy names another one.
+    inline auto default_pool()
+        -> thread_pool&
+    {
+        static thread_pool pool{default_concurrency()};
+        return pool;
+    }
+
+namespace execution {
+
+    struct sequenced_policy {};
+
+    // Splits ranges into chunks of grain_size elements that are processed
+    // by the tasks of pool. The chunking does not depend on the number of
+    // threads, so reductions give the same result for every pool size.
+    struct parallel_policy {
+        thread_pool* pool;
+        size_t grain_size;
+
+        auto on(thread_pool& p) const
+            -> parallel_policy
+        {
+            return {&p, grain_size};
+        }
+
+        auto grain(size_t size) const
+            -> parallel_policy
+        {
+            return {pool, size};
+        }
+    };
+
+    constexpr auto seq = sequenced_policy{};
+    constexpr auto par = parallel_policy{nullptr, 1024};
+
+} // namespace execution
+
+    namespace detail {
+
+        // Calls fn(first, last) for consecutive index ranges covering
+        // [0, size) and returns the results in order. The calling thread
+        // executes the chunks that no worker has started yet, but no other
+        // tasks of the pool: running an unrelated task while waiting could
+        // make it wait for work that the calling thread was supposed to
+        // finish.
+        template<class Fn>
+        auto parallel_chunks(const execution::parallel_policy& policy,
+            size_t size, Fn&& fn)
+        {
+            using result_type = decltype(fn(size_t{0}, size_t{0}));
+            auto& pool = policy.pool ? *policy.pool : default_pool();
+            auto grain = std::max<size_t>(policy.grain_size, 1);
+
+            // The tasks in the queues may outlive this call, after their
+            // chunk has been claimed by another thread.
+            struct state {
+                std::vector<std::packaged_task<result_type()>> chunks;
+                std::unique_ptr<std::atomic<bool>[]> claimed;
+
+                void run(size_t i) {
+                    if (!claimed[i].exchange(true)) {
+                        chunks[i]();
+                    }
+                }
+            };
+            auto shared = std::make_shared<state>();
+            auto results = std::vector<std::future<result_type>>{};
+            for (size_t first = 0; first < size; first += grain) {
+                auto last = std::min(size, first + grain);
+                shared->chunks.emplace_back(
+                    [&fn, first, last] { return fn(first, last); });
+                results.push_back(shared->chunks.back().get_future());
+            }
+            auto n = shared->chunks.size();
+            shared->claimed.reset(new std::atomic<bool>[n]);
+            for (size_t i = 0; i < n; ++i) {
+                shared->claimed[i] = false;
+            }
+            for (size_t i = 1; i < n; ++i) {
+                pool.submit([shared, i] { shared->run(i); });
+            }
+
+            for (size_t i = 0; i < n; ++i) {
+                shared->run(i);
+            }
+            // The remaining chunks are being executed by workers.
+            for (auto& result : results) {
+                result.wait();
+            }
+
+            auto values = std::vector<result_type>{};
+            for (auto& result : results) {
+                values.push_back(result.get());
+            }
+            return values;
+        }
+
+    } // namespace detail
+
+    template<class Range, class UnaryFunction>
+    auto for_each(execution::sequenced_policy, Range&& rng, UnaryFunction f)
+        -> UnaryFunction
+    {
+        return for_each(std::forward<Range>(rng), f);
+    }
+
+    template<class Range, class UnaryFunction>
+    void for_each(const execution::parallel_policy& policy, Range&& rng,
+        UnaryFunction f)
+    {
+        auto first = begin(rng);
+        detail::parallel_chunks(policy, size(rng),
+            [&](size_t l, size_t r) {
+                std::for_each(first + l, first + r, f);
+                return true;
+            });
+    }
+
+    template<class Range, class OutputIt, class UnaryOperation>
+    auto transform(execution::sequenced_policy, Range&& rng, OutputIt d_first,
+        UnaryOperation unary_op)
+        -> OutputIt
+    {
+        return transform(std::forward<Range>(rng), d_first, unary_op);
+    }
+
+    // d_first has to be a random access iterator.
+    template<class Range, class OutputIt, class UnaryOperation>
+    auto transform(const execution::parallel_policy& policy, Range&& rng,
+        OutputIt d_first, UnaryOperation unary_op)
+        -> OutputIt
+    {
+        auto first = begin(rng);
+        auto n = size(rng);
+        detail::parallel_chunks(policy, n,
+            [&](size_t l, size_t r) {
+                std::transform(first + l, first + r, d_first + l, unary_op);
+                return true;
+            });
+        return d_first + n;
+    }
+
+    template<class Range, class T, class BinaryOperation>
+    auto reduce(execution::sequenced_policy, Range&& rng, T init,
+        BinaryOperation op)
+        -> T
+    {
+        return std::accumulate(begin(rng), end(rng), init, op);
+    }
+
+    // op has to be associative. The elements of every chunk are reduced in
+    // order, then the partial results are reduced in order with init.
+    template<class Range, class T, class BinaryOperation>
+    auto reduce(const execution::parallel_policy& policy, Range&& rng, T init,
+        BinaryOperation op)
+        -> T
+    {
+        auto first = begin(rng);
+        auto partials = detail::parallel_chunks(policy, size(rng),
+            [&](size_t l, size_t r) {
+                return std::accumulate(first + l + 1, first + r,
+                    static_cast<T>(*(first + l)), op);
+            });
+        return std::accumulate(begin(partials), end(partials), init, op);
+    }
+
+    template<class Policy, class Range, class T>
+    auto accumulate(const Policy& policy, Range&& rng, T init)
+        -> T
+    {
+        return reduce(policy, std::forward<Range>(rng), init,
+            [](auto&& a, auto&& b) { return a + b; });
+    }
+
+    template<class Range, class UnaryPredicate>
+    auto count_if(execution::sequenced_policy, Range&& rng, UnaryPredicate p)
+        -> size_t
+    {
+        return static_cast<size_t>(std::count_if(begin(rng), end(rng), p));
+    }
+
+    template<class Range, class UnaryPredicate>
+    auto count_if(const execution::parallel_policy& policy, Range&& rng,
+        UnaryPredicate p)
+        -> size_t
+    {
+        auto first = begin(rng);
+        auto counts = detail::parallel_chunks(policy, size(rng),
+            [&](size_t l, size_t r) {
+                return static_cast<size_t>(
+                    std::count_if(first + l, first + r, p));
+            });
+        return std::accumulate(begin(counts), end(counts), size_t{0});
+    }
+
+    template<class Range, class Proj>
+    auto minmax(execution::sequenced_policy, Range&& rng, Proj&& proj) {
+        return minmax(std::forward<Range>(rng), std::forward<Proj>(proj));
+    }
+
+    template<class Range, class Proj>
+    auto minmax(const execution::parallel_policy& policy, Range&& rng,
+        Proj&& proj)
+    {
+        if (size(rng) == 0) {
+            throw std::invalid_argument{"empty range"};
+        }
+
+        auto first = begin(rng);
+        auto partials = detail::parallel_chunks(policy, size(rng),
+            [&](size_t l, size_t r) {
+                auto result = std::make_pair(proj(*(first + l)),
+                    proj(*(first + l)));
+                std::for_each(first + l + 1, first + r, [&](auto& e) {
+                    auto value = proj(e);
+                    result.first = std::min(result.first, value);
+                    result.second = std::max(result.second, value);
+                });
+                return result;
+            });
+        auto result = partials[0];
+        for (auto& p : partials) {
+            result.first = std::min(result.first, p.first);
+            result.second = std::max(result.second, p.second);
+        }
+        return result;
+    }
+
+} // namespace util
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#ifdef LDNN_USE_BLAS
+#include <cblas.h>
+#endif
+
+#include "arena.hpp"
+
+namespace util {
+
+    enum class transpose {
+        no,
+        yes
+    };
+
+    namespace detail {
+
+        // Register tile of the micro kernel: MR rows of A times NR columns
+        // of B are accumulated in MR * NR scalars, which the compiler keeps
+        // in vector registers.
+        constexpr size_t gemm_mr = 4;
+        constexpr size_t gemm_nr = 8;
+
+        // Cache blocks: a packed MC x KC block of A stays in L2, a packed
+        // KC x NC block of B in L3 and a KC x NR micro panel of it in L1.
+        constexpr size_t gemm_mc = 128;
+        constexpr size_t gemm_kc = 256;
+        constexpr size_t gemm_nc = 2048;
+
+        template<class T>
+        using gemm_buffer = std::vector<T, arena_allocator<T>>;
+
+        // Copies the block op(A)[i0, i0 + mc) x [p0, p0 + kc) into micro
+        // panels of MR rows, each stored column by column and zero padded.
+        template<class T>
+        void pack_a(transpose t, const T* a, size_t lda, size_t i0, size_t mc,
+            size_t p0, size_t kc, T* packed)
+        {
+            for (size_t ir = 0; ir < mc; ir += gemm_mr) {
+                auto mr = std::min(gemm_mr, mc - ir);
+                for (size_t p = 0; p < kc; ++p) {
+                    for (size_t r = 0; r < gemm_mr; ++r) {
+                        auto i = i0 + ir + r;
+                        *packed++ = r >= mr ? T{0} : t == transpose::no
+                            ? a[i * lda + p0 + p] : a[(p0 + p) * lda + i];
+                    }
+                }
+            }
+        }
+
+        // Copies the block op(B)[p0, p0 + kc) x [j0, j0 + nc) into micro
+        // panels of NR columns, each stored row by row and zero padded.
+        template<class T>
+        void pack_b(transpose t, const T* b, size_t ldb, size_t p0, size_t kc,
+            size_t j0, size_t nc, T* packed)
+        {
+            for (size_t jr = 0; jr < nc; jr += gemm_nr) {
+                auto nr = std::min(gemm_nr, nc - jr);
+                for (size_t p = 0; p < kc; ++p) {
+                    for (size_t c = 0; c < gemm_nr; ++c) {
+                        auto j = j0 + jr + c;
+                        *packed++ = c >= nr ? T{0} : t == transpose::no
+                            ? b[(p0 + p) * ldb + j] : b[j * ldb + p0 + p];
+                    }
+                }
+            }
+        }
+
+        // C[0, mr) x [0, nr) += alpha * A_panel * B_panel.
+        template<class T>
+        void gemm_micro_kernel(size_t kc, T alpha, const T* __restrict a,
+            const T* __restrict b, T* c, size_t ldc, size_t mr, size_t nr)
+        {
+            T acc[gemm_mr][gemm_nr] = {};
+            for (size_t p = 0; p < kc; ++p) {
+                for (size_t r = 0; r < gemm_mr; ++r) {
+                    auto ar = a[p * gemm_mr + r];
+                    for (size_t s = 0; s < gemm_nr; ++s) {
+                        acc[r][s] += ar * b[p * gemm_nr + s];
+                    }
+                }
+            }
+            for (size_t r = 0; r < mr; ++r) {
+                for (size_t s = 0; s < nr; ++s) {
+                    c[r * ldc + s] += alpha * acc[r][s];
+                }
+            }
+        }
+
+    } // namespace detail
+
+    // C = alpha * op(A) * op(B) + beta * C for row-major matrices, where
+    // op(A) is m x k, op(B) is k x n and op(X) is X or its transpose. This
+    // is the blocked algorithm of Goto and van de Geijn: blocks of A and B
+    // are packed into contiguous micro panels that fit the caches, and a
+    // register-tiled micro kernel multiplies them. The packing buffers come
+    // from the arena of the calling thread.
+    template<class T>
+    void gemm(transpose ta, transpose tb, size_t m, size_t n, size_t k,
+        T alpha, const T* a, size_t lda, const T* b, size_t ldb,
+        T beta, T* c, size_t ldc)
+    {
+        using namespace detail;
+
+        for (size_t i = 0; i < m; ++i) {
+            for (size_t j = 0; j < n; ++j) {
+                c[i * ldc + j] = beta == T{0} ? T{0} : beta * c[i * ldc + j];
+            }
+        }
+        if (alpha == T{0} || k == 0) {
+            return;
+        }
+
+        arena::scope scope;
+        auto packed_a = gemm_buffer<T>(
+            (std::min(m, gemm_mc) + gemm_mr) * std::min(k, gemm_kc));
+        auto packed_b = gemm_buffer<T>(
+            (std::min(n, gemm_nc) + gemm_nr) * std::min(k, gemm_kc));
+
+        for (size_t j0 = 0; j0 < n; j0 += gemm_nc) {
+            auto nc = std::min(gemm_nc, n - j0);
+            for (size_t p0 = 0; p0 < k; p0 += gemm_kc) {
+                auto kc = std::min(gemm_kc, k - p0);
+                pack_b(tb, b, ldb, p0, kc, j0, nc, packed_b.data());
+                for (size_t i0 = 0; i0 < m; i0 += gemm_mc) {
+                    auto mc = std::min(gemm_mc, m - i0);
+                    pack_a(ta, a, lda, i0, mc, p0, kc, packed_a.data());
+                    for (size_t jr = 0; jr < nc; jr += gemm_nr) {
+                        for (size_t ir = 0; ir < mc; ir += gemm_mr) {
+                            gemm_micro_kernel(kc, alpha,
+                                packed_a.data() + ir * kc,
+                                packed_b.data() + jr * kc,
+                                c + (i0 + ir) * ldc + j0 + jr, ldc,
+                                std::min(gemm_mr, mc - ir),
+                                std::min(gemm_nr, nc - jr));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+#ifdef LDNN_USE_BLAS
+    // With LDNN_USE_BLAS, float and double products are computed by the
+    // CBLAS implementation the program is linked against.
+    inline void gemm(transpose ta, transpose tb, size_t m, size_t n, size_t k,
+        float alpha, const float* a, size_t lda, const float* b, size_t ldb,
+        float beta, float* c, size_t ldc)
+    {
+        cblas_sgemm(CblasRowMajor,
+            ta == transpose::no ? CblasNoTrans : CblasTrans,
+            tb == transpose::no ? CblasNoTrans : CblasTrans,
+            static_cast<int>(m), static_cast<int>(n), static_cast<int>(k),
+            alpha, a, static_cast<int>(lda), b, static_cast<int>(ldb),
+            beta, c, static_cast<int>(ldc));
+    }
+
+    inline void gemm(transpose ta, transpose tb, size_t m, size_t n, size_t k,
+        double alpha, const double* a, size_t lda, const double* b, size_t ldb,
+        double beta, double* c, size_t ldc)
+    {
+        cblas_dgemm(CblasRowMajor,
+            ta == transpose::no ? CblasNoTrans : CblasTrans,
+            tb == transpose::no ? CblasNoTrans : CblasTrans,
+            static_cast<int>(m), static_cast<int>(n), static_cast<int>(k),
+            alpha, a, static_cast<int>(lda), b, static_cast<int>(ldb),
+            beta, c, static_cast<int>(ldc));
+    }
+#endif
+
+} // namespace util
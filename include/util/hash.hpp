@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace util {
+
+    // 64 bit FNV-1a, to identify strings by a short, stable hash.
+    inline auto fnv1a(const std::string& str)
+        -> uint64_t
+    {
+        auto hash = uint64_t{14695981039346656037u};
+        for (auto c : str) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= uint64_t{1099511628211u};
+        }
+        return hash;
+    }
+
+} // namespace util
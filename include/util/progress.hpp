@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+    // Adds x to a, for atomics without fetch_add.
+    template<class T>
+    void atomic_add(std::atomic<T>& a, T x) {
+        auto expected = a.load(std::memory_order_relaxed);
+        while (!a.compare_exchange_weak(expected, expected + x,
+            std::memory_order_relaxed)) {}
+    }
+
+// Reports the progress of a training loop on its own thread. The loop
+// publishes the epoch, the number of trained examples and their squared
+// errors with relaxed atomic operations, so it never waits for the output.
+// Every interval, the reporter overwrites the status line with the epoch,
+// the examples per second and the mean squared error since the last line.
+//
+// Lines are only written between start and stop, and stop waits for a line
+// that is being written, so the caller can print between rounds.
+class progress_reporter {
+public:
+    explicit progress_reporter(std::ostream& out,
+        std::chrono::milliseconds interval = std::chrono::milliseconds{250})
+        : out(out), interval(interval)
+    {
+        if (interval.count() > 0) {
+            thread = std::thread{[this] { run(); }};
+        }
+    }
+
+    progress_reporter(const progress_reporter&) = delete;
+    progress_reporter& operator=(const progress_reporter&) = delete;
+
+    ~progress_reporter() {
+        if (thread.joinable()) {
+            {
+                auto lock = std::unique_lock<std::mutex>{mutex};
+                stopping = true;
+            }
+            changed.notify_all();
+            thread.join();
+        }
+    }
+
+    // Reports nonzero values of counter as "<count> <name>", e.g. for
+    // numerical problems that are counted instead of printed. counter has
+    // to outlive the reporter.
+    void watch(std::string name, const std::atomic<size_t>& counter) {
+        auto lock = std::unique_lock<std::mutex>{mutex};
+        watched.emplace_back(std::move(name), &counter);
+    }
+
+    // Starts reporting on the epochs [first_epoch, epochs) of a round,
+    // whose lines begin with label.
+    void start(std::string label, size_t first_epoch, size_t epochs) {
+        auto lock = std::unique_lock<std::mutex>{mutex};
+        this->label = std::move(label);
+        epochs_ = epochs;
+        epoch_.store(first_epoch, std::memory_order_relaxed);
+        examples_.store(0, std::memory_order_relaxed);
+        squared_error_.store(0.0, std::memory_order_relaxed);
+        last_examples = 0;
+        last_squared_error = 0.0;
+        last_time = std::chrono::steady_clock::now();
+        active = true;
+    }
+
+    // Stops reporting. No line is written until the next start.
+    void stop() {
+        auto lock = std::unique_lock<std::mutex>{mutex};
+        active = false;
+    }
+
+    void set_epoch(size_t epoch) {
+        epoch_.store(epoch, std::memory_order_relaxed);
+    }
+
+    // Publishes that examples more examples have been trained on, with the
+    // given sum of their squared errors.
+    void add(size_t examples, double squared_error) {
+        examples_.fetch_add(examples, std::memory_order_relaxed);
+        atomic_add(squared_error_, squared_error);
+    }
+
+private:
+    void run() {
+        auto lock = std::unique_lock<std::mutex>{mutex};
+        while (!changed.wait_for(lock, interval, [&] { return stopping; })) {
+            if (active) {
+                report();
+            }
+        }
+    }
+
+    // Must be called with the mutex locked.
+    void report() {
+        auto now = std::chrono::steady_clock::now();
+        auto examples = examples_.load(std::memory_order_relaxed);
+        auto squared_error = squared_error_.load(std::memory_order_relaxed);
+        auto seconds = std::chrono::duration<double>(now - last_time).count();
+        auto new_examples = examples - last_examples;
+
+        out << label << epoch_.load(std::memory_order_relaxed) << "/"
+            << epochs_ << ", "
+            << static_cast<size_t>(new_examples / std::max(seconds, 1e-9))
+            << " examples/s";
+        if (new_examples > 0) {
+            out << ", mse " << (squared_error - last_squared_error)
+                / new_examples;
+        }
+        for (auto& w : watched) {
+            auto count = w.second->load(std::memory_order_relaxed);
+            if (count > 0) {
+                out << ", " << count << " " << w.first;
+            }
+        }
+        // clears what is left of a longer previous line
+        out << "    \r" << std::flush;
+
+        last_examples = examples;
+        last_squared_error = squared_error;
+        last_time = now;
+    }
+
+private:
+    std::ostream& out;
+    std::chrono::milliseconds interval;
+
+    std::atomic<size_t> epoch_{0};
+    std::atomic<size_t> examples_{0};
+    std::atomic<double> squared_error_{0.0};
+
+    // Guarded by the mutex.
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool active = false;
+    bool stopping = false;
+    std::string label;
+    size_t epochs_ = 0;
+    size_t last_examples = 0;
+    double last_squared_error = 0.0;
+    std::chrono::steady_clock::time_point last_time;
+    std::vector<std::pair<std::string, const std::atomic<size_t>*>> watched;
+
+    std::thread thread;
+};
+
+} // namespace util
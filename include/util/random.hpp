@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+
+namespace util {
+
+    // The Philox4x32-10 counter-based random number engine of Salmon et al.,
+    // "Parallel Random Numbers: As Easy as 1, 2, 3". Every output block is a
+    // function of a 64 bit key and a 128 bit counter only, so independent
+    // streams are created by deriving new keys instead of passing one
+    // sequential engine around. This makes results independent of the order
+    // in which threads consume random numbers.
+    class philox4x32 {
+    public:
+        using result_type = uint32_t;
+
+        explicit philox4x32(uint64_t seed = 0)
+            : key{{static_cast<uint32_t>(seed),
+                static_cast<uint32_t>(seed >> 32)}}
+        {}
+
+        static constexpr auto min()
+            -> result_type
+        {
+            return 0;
+        }
+
+        static constexpr auto max()
+            -> result_type
+        {
+            return std::numeric_limits<result_type>::max();
+        }
+
+        auto operator()()
+            -> result_type
+        {
+            if (index == 4) {
+                block = generate(counter, key);
+                increment();
+                index = 0;
+            }
+            return block[index++];
+        }
+
+        void discard(unsigned long long n) {
+            if (n <= 4 - index) {
+                index += static_cast<unsigned>(n);
+                return;
+            }
+            // Skip whole blocks without generating them.
+            n -= 4 - index;
+            add(0, static_cast<uint32_t>(n / 4));
+            add(1, static_cast<uint32_t>(n / 4 >> 32));
+            index = 4;
+            if (n % 4 > 0) {
+                block = generate(counter, key);
+                increment();
+                index = static_cast<unsigned>(n % 4);
+            }
+        }
+
+        // Returns the engine of the stream with the given id. Streams of
+        // different ids are independent of each other and of this engine,
+        // and don't depend on how many numbers have been drawn from it.
+        auto stream(uint64_t id) const
+            -> philox4x32
+        {
+            // The derived key is a block that this engine would only output
+            // after 2^96 numbers.
+            auto derived = generate({static_cast<uint32_t>(id),
+                static_cast<uint32_t>(id >> 32), 0, 0xffffffff}, key);
+            auto result = philox4x32{};
+            result.key = {{derived[0], derived[1]}};
+            return result;
+        }
+
+        // Returns the stream of the stream of ..., e.g. stream(round, epoch).
+        template<class... Ids>
+        auto stream(uint64_t id, uint64_t next, Ids... ids) const
+            -> philox4x32
+        {
+            return stream(id).stream(next, ids...);
+        }
+
+        friend auto operator==(const philox4x32& lhs, const philox4x32& rhs)
+            -> bool
+        {
+            return lhs.key == rhs.key && lhs.counter == rhs.counter
+                && lhs.index == rhs.index
+                && (lhs.index == 4 || lhs.block == rhs.block);
+        }
+
+        friend auto operator!=(const philox4x32& lhs, const philox4x32& rhs)
+            -> bool
+        {
+            return !(lhs == rhs);
+        }
+
+        // The state is written as key, counter and the position in the
+        // current block, which is regenerated when it is read back.
+        friend auto operator<<(std::ostream& o, const philox4x32& e)
+            -> std::ostream&
+        {
+            auto previous = e.index == 4 ? e.counter : e.previous_counter();
+            o << e.key[0] << " " << e.key[1];
+            for (auto c : previous) {
+                o << " " << c;
+            }
+            return o << " " << e.index;
+        }
+
+        friend auto operator>>(std::istream& i, philox4x32& e)
+            -> std::istream&
+        {
+            auto result = philox4x32{};
+            i >> result.key[0] >> result.key[1];
+            for (auto& c : result.counter) {
+                i >> c;
+            }
+            i >> result.index;
+            if (i && result.index < 4) {
+                result.block = generate(result.counter, result.key);
+                result.increment();
+            } else if (i && result.index != 4) {
+                i.setstate(std::ios::failbit);
+            }
+            if (i) {
+                e = result;
+            }
+            return i;
+        }
+
+    private:
+        using counter_type = std::array<uint32_t, 4>;
+        using key_type = std::array<uint32_t, 2>;
+
+        static auto generate(counter_type c, key_type k)
+            -> counter_type
+        {
+            for (auto round = 0; round < 10; ++round) {
+                auto p0 = uint64_t{0xD2511F53} * c[0];
+                auto p1 = uint64_t{0xCD9E8D57} * c[2];
+                c = {{static_cast<uint32_t>(p1 >> 32) ^ c[1] ^ k[0],
+                      static_cast<uint32_t>(p1),
+                      static_cast<uint32_t>(p0 >> 32) ^ c[3] ^ k[1],
+                      static_cast<uint32_t>(p0)}};
+                k[0] += 0x9E3779B9;
+                k[1] += 0xBB67AE85;
+            }
+            return c;
+        }
+
+        // Adds value to the counter, starting at word i.
+        void add(int i, uint32_t value) {
+            for (; i < 4; ++i) {
+                counter[i] += value;
+                if (counter[i] >= value) {
+                    return;
+                }
+                value = 1;
+            }
+        }
+
+        void increment() {
+            add(0, 1);
+        }
+
+        // The counter of the current block.
+        auto previous_counter() const
+            -> counter_type
+        {
+            auto c = counter;
+            for (auto i = 0; i < 4 && c[i]-- == 0; ++i) {}
+            return c;
+        }
+
+    private:
+        key_type key;
+        counter_type counter{{0, 0, 0, 0}};
+        counter_type block{{0, 0, 0, 0}};
+        unsigned index = 4;
+    };
+
+} // namespace util
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace util {
+
+    // A named POSIX shared memory segment mapped into the address space of
+    // the process. The segment outlives the process until it is unlinked,
+    // so that other processes can map it by its name, unless it is removed
+    // by its last user, see remove_when_unused.
+    class shared_memory {
+    public:
+        shared_memory(const shared_memory&) = delete;
+        shared_memory& operator=(const shared_memory&) = delete;
+
+        ~shared_memory() {
+            unmap();
+            if (unused_name.size() > 0) {
+                // A shared lock can't be upgraded atomically, so it is
+                // released first. Of the users that leave at the same time,
+                // at least one gets the exclusive lock and removes the name,
+                // the others fail to lock or find it removed.
+                ::flock(fd, LOCK_UN);
+                struct stat info = {};
+                if (::flock(fd, LOCK_EX | LOCK_NB) == 0
+                    && ::fstat(fd, &info) == 0 && info.st_nlink > 0) {
+                    ::shm_unlink(unused_name.c_str());
+                }
+            }
+            ::close(fd);
+        }
+
+        // Creates the segment name of size bytes, which is zero-initialized
+        // and mapped for reading and writing. Returns nullptr if a segment
+        // of that name exists already.
+        static auto create(const std::string& name, size_t size)
+            -> std::unique_ptr<shared_memory>
+        {
+            auto fd = ::shm_open(name.c_str(),
+                O_RDWR | O_CREAT | O_EXCL, 0644);
+            if (fd < 0) {
+                if (errno == EEXIST) {
+                    return nullptr;
+                }
+                throw_error("shm_open " + name);
+            }
+            auto result = std::unique_ptr<shared_memory>{
+                new shared_memory{fd, PROT_READ | PROT_WRITE}};
+            try {
+                result->resize(size);
+            } catch (...) {
+                ::shm_unlink(name.c_str());
+                throw;
+            }
+            return result;
+        }
+
+        // Maps the segment name read-only. Returns nullptr if there is no
+        // such segment. The segment can still be empty if its creator has
+        // not set its size yet.
+        static auto open(const std::string& name)
+            -> std::unique_ptr<shared_memory>
+        {
+            auto fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+            if (fd < 0) {
+                if (errno == ENOENT) {
+                    return nullptr;
+                }
+                throw_error("shm_open " + name);
+            }
+            auto result = std::unique_ptr<shared_memory>{
+                new shared_memory{fd, PROT_READ}};
+            struct stat info = {};
+            if (::fstat(fd, &info) != 0) {
+                throw_error("fstat " + name);
+            }
+            result->map(static_cast<size_t>(info.st_size));
+            return result;
+        }
+
+        // Removes the name of the segment, the memory is released once the
+        // last process has unmapped it. Returns false if there is no such
+        // segment.
+        static auto unlink(const std::string& name)
+            -> bool
+        {
+            if (::shm_unlink(name.c_str()) != 0) {
+                if (errno == ENOENT) {
+                    return false;
+                }
+                throw_error("shm_unlink " + name);
+            }
+            return true;
+        }
+
+        // Takes a shared lock on the segment name until this mapping is
+        // destroyed. The last process that held one removes the name then,
+        // also if it ends without destroying it: the next process that
+        // locks the segment takes over. Returns false if the name has been
+        // removed already, so that the segment should not be used.
+        auto remove_when_unused(const std::string& name)
+            -> bool
+        {
+            if (::flock(fd, LOCK_SH) != 0) {
+                throw_error("flock " + name);
+            }
+            struct stat info = {};
+            if (::fstat(fd, &info) != 0) {
+                throw_error("fstat " + name);
+            }
+            if (info.st_nlink == 0) {
+                ::flock(fd, LOCK_UN);
+                return false;
+            }
+            unused_name = name;
+            return true;
+        }
+
+        // Changes the size of a created segment and maps all of it again, so
+        // data() can change. Bytes beyond the old size are zero.
+        void resize(size_t size) {
+            if ((protection & PROT_WRITE) == 0) {
+                throw std::logic_error{"only created segments can be resized"};
+            }
+            if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                throw_error("ftruncate");
+            }
+            unmap();
+            map(size);
+        }
+
+        // Makes the mapping read-only once the segment has been written.
+        void protect() {
+            if (size_ > 0 && ::mprotect(address, size_, PROT_READ) != 0) {
+                throw_error("mprotect");
+            }
+        }
+
+        auto data() const
+            -> void*
+        {
+            return size_ > 0 ? address : nullptr;
+        }
+
+        auto size() const
+            -> size_t
+        {
+            return size_;
+        }
+
+    private:
+        shared_memory(int fd, int protection)
+            : fd(fd), protection(protection)
+        {}
+
+        void map(size_t size) {
+            if (size > 0) {
+                address = ::mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+                if (address == MAP_FAILED) {
+                    throw_error("mmap");
+                }
+            }
+            size_ = size;
+        }
+
+        void unmap() {
+            if (address != MAP_FAILED) {
+                ::munmap(address, size_);
+                address = MAP_FAILED;
+            }
+            size_ = 0;
+        }
+
+        [[noreturn]] static void throw_error(const std::string& what) {
+            throw std::runtime_error{what + ": " + std::strerror(errno)};
+        }
+
+    private:
+        // Kept open for resizing created segments and for the lock of
+        // remove_when_unused.
+        int fd;
+        int protection;
+        void* address = MAP_FAILED;
+        size_t size_ = 0;
+        std::string unused_name;
+    };
+
+    // A read-only array of n values of type T in a shared memory segment,
+    // which stays mapped as long as an array refers to it.
+    template<class T>
+    class shared_array {
+    public:
+        using value_type = T;
+
+        shared_array() = default;
+
+        shared_array(std::shared_ptr<const shared_memory> segment,
+            const T* first, size_t n)
+            : segment(std::move(segment)), first(first), n(n)
+        {}
+
+        auto data() const
+            -> const T*
+        {
+            return first;
+        }
+
+        auto size() const
+            -> size_t
+        {
+            return n;
+        }
+
+        auto begin() const
+            -> const T*
+        {
+            return first;
+        }
+
+        auto end() const
+            -> const T*
+        {
+            return first + n;
+        }
+
+        auto operator[](size_t i) const
+            -> const T&
+        {
+            return first[i];
+        }
+
+    private:
+        std::shared_ptr<const shared_memory> segment;
+        const T* first = nullptr;
+        size_t n = 0;
+    };
+
+} // namespace util
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+    // A fixed number of worker threads with one task queue each. Tasks that
+    // are submitted by a worker are pushed to its own queue and executed
+    // last-in first-out; idle workers steal the oldest tasks from the queues
+    // of the others. A task that waits for tasks it submitted has to run
+    // them itself if no worker has started them, as parallel_chunks does.
+    class thread_pool {
+    public:
+        // Creates a pool with the given number of threads. A thread_count
+        // of 0 uses the number of hardware threads.
+        explicit thread_pool(size_t thread_count = 0) {
+            if (thread_count == 0) {
+                thread_count = std::max(1u, std::thread::hardware_concurrency());
+            }
+            for (size_t i = 0; i < thread_count; ++i) {
+                queues.emplace_back(new queue{});
+            }
+            for (size_t i = 0; i < thread_count; ++i) {
+                workers.emplace_back([this, i] { work(i); });
+            }
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        ~thread_pool() {
+            {
+                auto lock = std::unique_lock<std::mutex>{mutex};
+                stopped = true;
+            }
+            changed.notify_all();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        auto size() const
+            -> size_t
+        {
+            return workers.size();
+        }
+
+        // Schedules f() for execution and returns a future for its result.
+        template<class F>
+        auto submit(F&& f)
+            -> std::future<typename std::result_of<F()>::type>
+        {
+            using result_type = typename std::result_of<F()>::type;
+            auto task = std::make_shared<std::packaged_task<result_type()>>(
+                std::forward<F>(f));
+            auto result = task->get_future();
+
+            auto& self = current_worker();
+            auto index = self.first == this
+                ? self.second
+                : next_queue++ % queues.size();
+            {
+                auto lock = std::unique_lock<std::mutex>{mutex};
+                pending++;
+            }
+            {
+                auto& q = *queues[index];
+                auto lock = std::unique_lock<std::mutex>{q.mutex};
+                q.tasks.emplace_back([task] { (*task)(); });
+            }
+            changed.notify_one();
+            return result;
+        }
+
+    private:
+        struct queue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        // The pool and queue index of the calling thread, if it is a worker.
+        static auto current_worker()
+            -> std::pair<thread_pool*, size_t>&
+        {
+            static thread_local auto worker =
+                std::pair<thread_pool*, size_t>{nullptr, 0};
+            return worker;
+        }
+
+        // Pops the newest task of the own queue or steals the oldest task of
+        // another queue.
+        auto take(size_t index, std::function<void()>& task)
+            -> bool
+        {
+            {
+                auto& q = *queues[index];
+                auto lock = std::unique_lock<std::mutex>{q.mutex};
+                if (!q.tasks.empty()) {
+                    task = std::move(q.tasks.back());
+                    q.tasks.pop_back();
+                    return true;
+                }
+            }
+            for (size_t offset = 1; offset < queues.size(); ++offset) {
+                auto& q = *queues[(index + offset) % queues.size()];
+                auto lock = std::unique_lock<std::mutex>{q.mutex};
+                if (!q.tasks.empty()) {
+                    task = std::move(q.tasks.front());
+                    q.tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(size_t index) {
+            current_worker() = {this, index};
+            while (true) {
+                auto task = std::function<void()>{};
+                if (take(index, task)) {
+                    {
+                        auto lock = std::unique_lock<std::mutex>{mutex};
+                        pending--;
+                    }
+                    task();
+                    continue;
+                }
+
+                // A task may have been counted but not yet been pushed, so
+                // only sleep while nothing is pending.
+                auto lock = std::unique_lock<std::mutex>{mutex};
+                if (pending > 0) {
+                    lock.unlock();
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (stopped) {
+                    return;
+                }
+                changed.wait(lock, [&] { return stopped || pending > 0; });
+            }
+        }
+
+    private:
+        std::vector<std::unique_ptr<queue>> queues;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        size_t pending = 0;
+        bool stopped = false;
+        std::atomic<size_t> next_queue{0};
+
+        std::vector<std::thread> workers;
+    };
+
+} // namespace util
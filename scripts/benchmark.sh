@@ -0,0 +1,88 @@
+#!/bin/bash
+# Measures how ldnn scales with the number of examples, the rank and the
+# number of polytopes on synthetic data and prints one tab separated line
+# per configuration. Usage:
+#
+#   benchmark.sh <ldnn> <ldnn_generate> [output]
+#
+# The swept values can be overridden with the environment variables ROWS,
+# RANKS, POLYTOPES (space separated lists), HALFSPACES, EPOCHS, FORMAT
+# (tsv or binary) and SEED.
+set -e -o pipefail
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <ldnn> <ldnn_generate> [output]" >&2
+    exit 1
+fi
+ldnn=$(realpath "$1")
+generate=$(realpath "$2")
+if [ $# -ge 3 ]; then
+    exec > "$3"
+fi
+
+ROWS=${ROWS:-"10000 100000"}
+RANKS=${RANKS:-"8 32"}
+POLYTOPES=${POLYTOPES:-"2 4 8"}
+HALFSPACES=${HALFSPACES:-4}
+EPOCHS=${EPOCHS:-5}
+FORMAT=${FORMAT:-binary}
+SEED=${SEED:-1}
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT
+
+printf "rows\trank\tpolytopes\tload_ms\tinit_ms\tepoch_ms\tpeak_mb\taccuracy\n"
+for rows in $ROWS; do
+for rank in $RANKS; do
+for polytopes in $POLYTOPES; do
+    data="$workdir/data.$FORMAT"
+    "$generate" -o "$data" -f "$FORMAT" -r "$rows" -d "$rank" \
+        -p "$polytopes" -h "$HALFSPACES" -s "$SEED" 2> "$workdir/generate.log" \
+        || { cat "$workdir/generate.log" >&2; exit 1; }
+
+    # the tsv files are read by the csv loader
+    format=$FORMAT
+    if [ "$format" = tsv ]; then
+        format=csv
+    fi
+    dimensions=$(seq -s, 0 $((rank - 1)))
+    cat > "$workdir/benchmark.ini" <<EOF
+[data]
+filename = $data
+format = $format
+classification_dimension = $rank
+dimensions = [$dimensions]
+[network]
+polytope_count = $polytopes
+max_halfspaces = $HALFSPACES
+alpha = 0.05
+kmeans_iterations = 10
+[optimizer]
+type = adam
+[training]
+seed = $SEED
+iterations = 1
+gradient_iterations = $EPOCHS
+EOF
+
+    "$ldnn" -c "$workdir/benchmark.ini" | tr '\r' '\n' | awk \
+        -v rows="$rows" -v rank="$rank" -v polytopes="$polytopes" '
+        /^loaded / { load = $(NF) }
+        /initialized in/ {
+            for (i = 1; i <= NF; ++i) {
+                if ($i == "in") init = $(i + 1)
+                if ($i == "per") epoch = $(i - 1)
+            }
+        }
+        /correctly classified/ { accuracy = $1 }
+        /^peak memory:/ { peak = $3 }
+        END {
+            gsub(/ms,?|MB|%/, "", load); gsub(/ms,?|MB|%/, "", init)
+            gsub(/ms,?|MB|%/, "", epoch); gsub(/ms,?|MB|%/, "", peak)
+            gsub(/%/, "", accuracy)
+            printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n", rows, rank,
+                polytopes, load, init, epoch, peak, accuracy
+        }'
+done
+done
+done
@@ -0,0 +1,64 @@
+#!/bin/bash
+# Runs a distributed training on this machine: starts one ldnn process per
+# rank with the same config, connected in a ring over unix sockets. The
+# output of rank 0 is printed, the log of any other rank only if it fails.
+# Usage:
+#
+#   distributed.sh <ldnn> <config> <ranks> [ldnn options]
+#
+# The peers of the config are replaced by the sockets, everything else,
+# including the sync_interval, is kept. Relative paths in the config are
+# resolved against the working directory, as for ldnn itself. With one rank,
+# the config is trained on by a single process.
+set -e -o pipefail
+
+if [ $# -lt 3 ]; then
+    echo "usage: $0 <ldnn> <config> <ranks> [ldnn options]" >&2
+    exit 1
+fi
+ldnn=$(realpath "$1")
+config=$2
+ranks=$3
+shift 3
+
+workdir=$(mktemp -d)
+pids=()
+cleanup() {
+    if [ ${#pids[@]} -gt 0 ]; then
+        kill "${pids[@]}" 2> /dev/null || true
+    fi
+    rm -rf "$workdir"
+}
+trap cleanup EXIT
+
+# inih joins repeated keys, so the peers of the config are dropped before
+# the sockets are appended.
+peers=$(for rank in $(seq 0 $((ranks - 1))); do
+    echo "unix:$workdir/$rank.sock"
+done | paste -sd,)
+awk '/^[[:space:]]*\[/ { distributed = /^[[:space:]]*\[distributed\]/ }
+    !distributed || !/^[[:space:]]*peers[[:space:]]*[=:]/' "$config" \
+    > "$workdir/ldnn.ini"
+printf "\n[distributed]\npeers = [%s]\n" "$peers" >> "$workdir/ldnn.ini"
+
+for rank in $(seq 1 $((ranks - 1))); do
+    "$ldnn" -c "$workdir/ldnn.ini" --rank "$rank" "$@" \
+        > "$workdir/$rank.log" 2>&1 &
+    pids+=($!)
+done
+
+status=0
+"$ldnn" -c "$workdir/ldnn.ini" --rank 0 "$@" || status=$?
+if [ $status -ne 0 ]; then
+    # the other ranks would wait for rank 0 until their connections time out
+    exit $status
+fi
+for i in "${!pids[@]}"; do
+    if ! wait "${pids[$i]}"; then
+        status=1
+        echo "rank $((i + 1)) failed:" >&2
+        cat "$workdir/$((i + 1)).log" >&2
+    fi
+done
+pids=()
+exit $status
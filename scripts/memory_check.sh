@@ -0,0 +1,77 @@
+#!/bin/bash
+# Checks that training on a large synthetic data set holds its examples only
+# once: the peak memory of ldnn has to stay within the size of the loaded
+# examples plus O(k * rank) for the network, where k is the number of
+# halfspaces. Usage:
+#
+#   memory_check.sh <ldnn> <ldnn_generate>
+#
+# The data set can be changed with the environment variables ROWS, RANK,
+# POLYTOPES, HALFSPACES and SEED. BASE_MB is the allowance for the process
+# itself and ROW_BYTES the one for the bookkeeping of every example: its
+# vector, label and the index lists of the partitioning and the network.
+set -e -o pipefail
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <ldnn> <ldnn_generate>" >&2
+    exit 1
+fi
+ldnn=$(realpath "$1")
+generate=$(realpath "$2")
+
+ROWS=${ROWS:-400000}
+RANK=${RANK:-32}
+POLYTOPES=${POLYTOPES:-4}
+HALFSPACES=${HALFSPACES:-4}
+SEED=${SEED:-1}
+BASE_MB=${BASE_MB:-8}
+ROW_BYTES=${ROW_BYTES:-128}
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT
+
+"$generate" -o "$workdir/data.bin" -f binary -r "$ROWS" -d "$RANK" \
+    -p "$POLYTOPES" -h "$HALFSPACES" -s "$SEED" 2> "$workdir/generate.log" \
+    || { cat "$workdir/generate.log" >&2; exit 1; }
+
+cat > "$workdir/memory_check.ini" <<EOF
+[data]
+filename = $workdir/data.bin
+format = binary
+classification_dimension = $RANK
+dimensions = [$(seq -s, 0 $((RANK - 1)))]
+[network]
+polytope_count = $POLYTOPES
+max_halfspaces = $HALFSPACES
+alpha = 0.05
+kmeans_iterations = 10
+[optimizer]
+type = adam
+[training]
+seed = $SEED
+iterations = 1
+gradient_iterations = 1
+EOF
+
+peak=$("$ldnn" -c "$workdir/memory_check.ini" | tr '\r' '\n' \
+    | awk '/^peak memory:/ { gsub(/MB/, "", $3); print $3 }')
+if [ -z "$peak" ]; then
+    echo "ldnn didn't report its peak memory" >&2
+    exit 1
+fi
+
+# The examples are loaded as doubles. The network, its optimizer state and
+# the k-means centroids take a few copies of k * rank doubles.
+awk -v peak="$peak" -v rows="$ROWS" -v rank="$RANK" \
+    -v k=$((POLYTOPES * HALFSPACES)) -v base="$BASE_MB" -v row="$ROW_BYTES" '
+    BEGIN {
+        examples = rows * (rank * 8 + row) / 1048576
+        network = 16 * k * rank * 8 / 1048576
+        limit = base + examples + network
+        printf "peak memory %.1fMB, examples %.1fMB, limit %.1fMB\n",
+            peak, examples, limit
+        if (peak > limit) {
+            print "peak memory exceeds the limit" > "/dev/stderr"
+            exit 1
+        }
+    }'
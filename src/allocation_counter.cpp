@@ -0,0 +1,43 @@
+#include "util/allocation_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+    std::atomic<size_t> allocations{0};
+
+} // namespace
+
+namespace util {
+
+    auto allocation_count()
+        -> size_t
+    {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+} // namespace util
+
+#ifdef LDNN_COUNT_ALLOCATIONS
+
+// Replace the global allocation functions to count every allocation.
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+#endif
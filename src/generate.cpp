@@ -0,0 +1,181 @@
+// Writes synthetic data sets whose positive class is a union of convex
+// polytopes, the shape an LDNN can represent exactly.
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <cxxopts.hpp>
+
+#include "util/indices.hpp"
+#include "util/random.hpp"
+
+#include "ldnn/binary_data.hpp"
+
+namespace {
+
+// The intersection of the halfspaces normal[j] * x <= offset[j].
+struct polytope {
+    std::vector<std::vector<double>> normal;
+    std::vector<double> offset;
+
+    auto contains(const std::vector<double>& x) const
+        -> bool
+    {
+        for (auto j : indices(normal.size())) {
+            auto dot = 0.0;
+            for (auto k : indices(x.size())) {
+                dot += normal[j][k] * x[k];
+            }
+            if (dot > offset[j]) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Creates a polytope of the given number of halfspaces around a random
+// center in [0, 1]^dimensions. The halfspaces have random normals and are
+// radius standard deviations of the projection of uniform data away from
+// the center.
+template<class URBG>
+auto random_polytope(size_t dimensions, size_t halfspaces, double radius,
+    URBG&& gen)
+    -> polytope
+{
+    auto uniform = std::uniform_real_distribution<double>{};
+    auto normal = std::normal_distribution<double>{};
+    auto center = std::vector<double>(dimensions);
+    for (auto& c : center) {
+        c = uniform(gen);
+    }
+
+    auto result = polytope{};
+    for (auto j = halfspaces; j-- > 0; ) {
+        auto n = std::vector<double>(dimensions);
+        auto length = 0.0;
+        for (auto& e : n) {
+            e = normal(gen);
+            length += e * e;
+        }
+        auto offset = 0.0;
+        for (auto k : indices(dimensions)) {
+            n[k] /= std::sqrt(length);
+            offset += n[k] * center[k];
+        }
+        // The projection of a uniform point onto a unit vector has a
+        // standard deviation of at most sqrt(1 / 12).
+        result.normal.push_back(std::move(n));
+        result.offset.push_back(offset + radius * std::sqrt(1.0 / 12.0));
+    }
+    return result;
+}
+
+int generate_main(int argc, char *argv[]) {
+    auto cmdopt = cxxopts::Options{"ldnn_generate",
+        "Writes a synthetic data set for ldnn, the last column is the "
+        "classification"};
+    cmdopt.add_options()
+        ("o,output", "output filename", cxxopts::value<std::string>())
+        ("f,format", "tsv or binary",
+            cxxopts::value<std::string>()->default_value("tsv"))
+        ("r,rows", "number of examples",
+            cxxopts::value<size_t>()->default_value("10000"))
+        ("d,dimensions", "number of features",
+            cxxopts::value<size_t>()->default_value("8"))
+        ("p,polytopes", "number of polytopes of the positive class",
+            cxxopts::value<size_t>()->default_value("3"))
+        ("h,halfspaces", "number of halfspaces per polytope",
+            cxxopts::value<size_t>()->default_value("4"))
+        ("radius", "distance of the halfspaces from the polytope centers",
+            cxxopts::value<double>()->default_value("1.0"))
+        ("n,noise", "probability that a classification is flipped",
+            cxxopts::value<double>()->default_value("0.0"))
+        ("s,seed", "random seed",
+            cxxopts::value<uint64_t>()->default_value("0"));
+    auto options = cmdopt.parse(argc, argv);
+    if (options.count("output") == 0) {
+        throw std::invalid_argument{"no output filename given"};
+    }
+    auto filename = options["output"].as<std::string>();
+    auto format = options["format"].as<std::string>();
+    if (format != "tsv" && format != "binary") {
+        throw std::invalid_argument{"unknown format " + format};
+    }
+    auto rows = options["rows"].as<size_t>();
+    auto dimensions = options["dimensions"].as<size_t>();
+    auto noise = options["noise"].as<double>();
+
+    auto rng = util::philox4x32{options["seed"].as<uint64_t>()};
+    auto polytopes = std::vector<polytope>{};
+    for (auto i : indices(options["polytopes"].as<size_t>())) {
+        polytopes.push_back(random_polytope(dimensions,
+            options["halfspaces"].as<size_t>(),
+            options["radius"].as<double>(), rng.stream(0, i)));
+    }
+
+    auto file = std::ofstream{filename, std::ios::binary};
+    if (!file.is_open()) {
+        throw std::invalid_argument{filename + " couldn't be opened!"};
+    }
+    if (format == "binary") {
+        ldnn::binary_format::write_header(file, rows, dimensions + 1);
+    }
+
+    auto gen = rng.stream(1);
+    auto uniform = std::uniform_real_distribution<double>{};
+    auto row = std::vector<double>(dimensions + 1);
+    auto x = std::vector<double>(dimensions);
+    auto positives = size_t{0};
+    for (auto remaining = rows; remaining-- > 0; ) {
+        for (auto& e : x) {
+            e = uniform(gen);
+        }
+        auto positive = false;
+        for (auto& p : polytopes) {
+            if (p.contains(x)) {
+                positive = true;
+                break;
+            }
+        }
+        if (uniform(gen) < noise) {
+            positive = !positive;
+        }
+        positives += positive ? 1 : 0;
+
+        std::copy(begin(x), end(x), begin(row));
+        row.back() = positive ? 1.0 : 0.0;
+        if (format == "binary") {
+            ldnn::binary_format::write_row(file, row.data(), row.size());
+        } else {
+            for (auto k : indices(row.size())) {
+                file << (k > 0 ? "\t" : "") << row[k];
+            }
+            file << "\n";
+        }
+    }
+    if (!file) {
+        throw std::runtime_error{"writing " + filename + " failed"};
+    }
+
+    std::cerr << rows << " rows, "
+              << 100.0 * positives / std::max<size_t>(rows, 1)
+              << "% positive\n";
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    try {
+        return generate_main(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+    }
+    return 1;
+}
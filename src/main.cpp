@@ -1,20 +1,84 @@
 #include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <random>
 #include <regex>
+#include <sstream>
 #include <string>
 
+#include <sys/resource.h>
+
 #include <cxxopts.hpp>
 #include <INIReader.h>
 
+#include "util/allocation_counter.hpp"
+#include "util/hash.hpp"
+#include "util/progress.hpp"
+#include "util/random.hpp"
+
+#include "ldnn/async_data.hpp"
+#include "ldnn/binary_data.hpp"
+#include "ldnn/checkpoint.hpp"
 #include "ldnn/data.hpp"
+#include "ldnn/distributed.hpp"
+#include "ldnn/evaluation.hpp"
+#include "ldnn/fixed_kernel.hpp"
+#include "ldnn/multiclass.hpp"
+#include "ldnn/online.hpp"
+#include "ldnn/quantized.hpp"
+#include "ldnn/sampling.hpp"
+#include "ldnn/shared_dataset.hpp"
+#include "ldnn/sweep.hpp"
 
 using namespace std::literals;
 
+enum class data_format {
+    // Tab separated values, one column is the classification.
+    csv,
+
+    // Sparse vectors in the libsvm format, see ldnn::read_libsvm_data.
+    libsvm,
+
+    // The columns of the csv format as doubles, see ldnn::binary_format.
+    binary
+};
+
+// How the features are kept in memory during training, see
+// ldnn::compact_matrix.
+enum class feature_storage {
+    double_precision,
+    float16,
+    bfloat16,
+    fixed8
+};
+
 struct config_t {
     // The name of the csv that contains the input data
     std::string filename;
 
+    data_format format;
+
+    // Encoding of the features of csv and binary data in memory.
+    feature_storage storage;
+
+    // Whether the loaded features are shared with other processes on the
+    // same host that load the same data, see ldnn::share_dataset. Shared
+    // features are trained on by row like the other storages, so without
+    // pruning, quantization and batches even if they are stored as double.
+    bool shared;
+
+    // Whether shared features that this process loads stay in memory after
+    // the last process that uses them has exited, until they are removed
+    // with --unshare.
+    bool persistent;
+
     // The dimension of the input vectors that contains the classification for
     // that vector.
     size_t classification_dimension;
@@ -23,11 +87,72 @@ struct config_t {
     // the classification dimension)
     std::vector<size_t> dimensions;
 
+    // Whether the input data is parsed on a background thread while the
+    // already parsed part is being prepared.
+    bool async_load;
+
+    // Number of lines per chunk when loading asynchronously.
+    size_t chunk_size;
+
+    // Whether the classification dimension contains more than two classes.
+    // One network per class is trained to separate it from the others.
+    bool multiclass;
+
     // Number of cross validation iterations.
     size_t iterations;
 
     // Number of gradient descent iterations.
     size_t gradient_iterations;
+
+    // Number of worker threads, 0 uses the number of hardware threads.
+    size_t threads;
+
+    // Seed of all random decisions. If none is configured, a random seed is
+    // used and printed, so that the run can be repeated.
+    bool has_seed;
+    uint64_t seed;
+
+    // Tolerance for pruning constant halfspaces and polytopes after
+    // training. A value of 0 disables pruning.
+    double prune_tolerance;
+
+    // Whether to compare the trained networks with their int8 quantized
+    // versions.
+    bool quantize;
+
+    // Addresses of all processes of a distributed training run, ordered by
+    // rank. With fewer than two peers, training is not distributed.
+    std::vector<std::string> peers;
+
+    // Rank of this process in peers.
+    size_t rank;
+
+    // Number of local training steps between two parameter averages.
+    size_t sync_interval;
+
+    // File that the training progress is saved to every
+    // checkpoint_interval epochs. An empty filename disables checkpoints.
+    std::string checkpoint;
+    size_t checkpoint_interval;
+
+    // Whether to continue from the checkpoint file if there is one.
+    bool resume;
+
+    // Milliseconds between two progress lines during training, 0 disables
+    // them.
+    size_t progress_interval;
+
+    // Settings of importance sampling of the training examples.
+    ldnn::importance_sampler<double>::config_t sampling;
+
+    // Settings of online learning from a stream.
+    ldnn::online_learner<double>::config_t online;
+};
+
+// Ids of the random streams of a cross validation round. The training
+// stream has one substream per epoch.
+enum round_stream : uint64_t {
+    partition_stream, initialization_stream, training_stream
 };
 
 template<class T, class URBG>
@@ -42,6 +167,30 @@ auto random_partition(std::vector<T>& vec, double p, URBG&& gen)
         std::vector<T>(split_at, end(vec)));
 }
 
+// Moves the elements of vec at the given rows into a new vector, so that a
+// part of a large dataset is used without copying it. put_rows moves them
+// back.
+template<class T>
+auto take_rows(std::vector<T>& vec, const std::vector<size_t>& rows)
+    -> std::vector<T>
+{
+    auto result = std::vector<T>{};
+    result.reserve(rows.size());
+    for (auto i : rows) {
+        result.push_back(std::move(vec[i]));
+    }
+    return result;
+}
+
+template<class T>
+void put_rows(std::vector<T>& vec, const std::vector<size_t>& rows,
+    std::vector<T>&& taken)
+{
+    for (auto i : indices(rows.size())) {
+        vec[rows[i]] = std::move(taken[i]);
+    }
+}
+
 auto read_config(const std::string& filename)
     -> config_t
 {
@@ -52,11 +201,44 @@ auto read_config(const std::string& filename)
     auto config = config_t{};
 
     config.filename = ini_config.Get("data", "filename", "");
+
+    auto format = ini_config.Get("data", "format", "csv");
+    if (format == "csv") {
+        config.format = data_format::csv;
+    } else if (format == "libsvm") {
+        config.format = data_format::libsvm;
+    } else if (format == "binary") {
+        config.format = data_format::binary;
+    } else {
+        throw std::invalid_argument{"The value " + format
+            + " is not valid for parameter data.format!"};
+    }
+
+    auto storage = ini_config.Get("data", "storage", "double");
+    if (storage == "double") {
+        config.storage = feature_storage::double_precision;
+    } else if (storage == "float16") {
+        config.storage = feature_storage::float16;
+    } else if (storage == "bfloat16") {
+        config.storage = feature_storage::bfloat16;
+    } else if (storage == "fixed8") {
+        config.storage = feature_storage::fixed8;
+    } else {
+        throw std::invalid_argument{"The value " + storage
+            + " is not valid for parameter data.storage!"};
+    }
+
+    config.shared = ini_config.GetBoolean("data", "shared", false);
+    config.persistent = ini_config.GetBoolean("data", "persistent", false);
+
+    // libsvm data has its classification in the first column and uses all
+    // dimensions.
     config.classification_dimension = static_cast<size_t>(
         ini_config.GetInteger("data", "classification_dimension", 0));
 
     auto dim_str = ini_config.Get("data", "dimensions", "");
-    if (!std::regex_match(dim_str, std::regex{"\\[([0-9]+,)+[0-9]+\\]"}))
+    if (config.format != data_format::libsvm
+        && !std::regex_match(dim_str, std::regex{"\\[([0-9]+,)+[0-9]+\\]"}))
         throw std::invalid_argument{"The value " + dim_str
             + "is not valid for parameter data.dimensions!"};
     auto r = std::regex{"[0-9]+"};
@@ -67,81 +249,884 @@ auto read_config(const std::string& filename)
             config.dimensions.push_back(std::stoul(match.str()));
         });
 
+    config.async_load = ini_config.GetBoolean("data", "async_load", false);
+    config.chunk_size = static_cast<size_t>(
+        ini_config.GetInteger("data", "chunk_size", 4096));
+
+    config.multiclass = ini_config.GetBoolean("data", "multiclass", false);
+
     config.iterations = static_cast<size_t>(
         ini_config.GetInteger("training", "iterations", 0));
     config.gradient_iterations = static_cast<size_t>(
         ini_config.GetInteger("training", "gradient_iterations", 0));
+    config.threads = static_cast<size_t>(
+        ini_config.GetInteger("training", "threads", 0));
+    auto seed_str = ini_config.Get("training", "seed", "");
+    config.has_seed = seed_str.size() > 0;
+    config.seed = config.has_seed ? std::stoull(seed_str) : 0;
+    config.prune_tolerance =
+        ini_config.GetReal("training", "prune_tolerance", 0.0);
+    config.quantize = ini_config.GetBoolean("training", "quantize", false);
+    config.checkpoint = ini_config.Get("training", "checkpoint", "");
+    config.checkpoint_interval = static_cast<size_t>(
+        ini_config.GetInteger("training", "checkpoint_interval", 1));
+    config.resume = false;
+    config.progress_interval = static_cast<size_t>(
+        ini_config.GetInteger("training", "progress_interval", 250));
+
+    config.peers = ldnn::parse_peers(
+        ini_config.Get("distributed", "peers", ""));
+    config.rank = static_cast<size_t>(
+        ini_config.GetInteger("distributed", "rank", 0));
+    config.sync_interval = static_cast<size_t>(
+        ini_config.GetInteger("distributed", "sync_interval", 100));
+
+    config.sampling.fraction =
+        ini_config.GetReal("sampling", "fraction", 0.0);
+    config.sampling.uniform = ini_config.GetReal("sampling", "uniform", 0.1);
+    config.sampling.full_pass_interval = static_cast<size_t>(
+        ini_config.GetInteger("sampling", "full_pass_interval", 8));
+
+    config.online.warmup = static_cast<size_t>(
+        ini_config.GetInteger("online", "warmup", 1000));
+    config.online.batch_size = static_cast<size_t>(
+        ini_config.GetInteger("online", "batch_size", 100));
+    config.online.epoch_size = static_cast<size_t>(ini_config.GetInteger(
+        "online", "epoch_size", static_cast<long>(config.online.warmup)));
 
     return config;
 }
 
-int ldnn_main(int argc, char *argv[]) {
-    auto cmdopt = cxxopts::Options{
-        "ldnn", "C++ implementation of a Logistic Disjunctive Normal Network"};
-    cmdopt.add_options()
-        ("c,config", "ini config filename", cxxopts::value<std::string>());
-    auto options = cmdopt.parse(argc, argv);
-    auto config_filename = "ldnn.ini"s;
-    if (options.count("config") > 0) {
-        config_filename = options["config"].as<std::string>();
+// Calls f(features, label) with the configured dimensions and the
+// classification of every row of the input data as soon as it is parsed, so
+// that the input data is never held as a whole.
+template<class F>
+void for_each_example(const config_t& config, F&& f)
+{
+    auto prepare = [&](ldnn::vector<double>&& vec) {
+        f(ldnn::select_dimensions(
+            ldnn::remove_dimension(vec, config.classification_dimension),
+            config.dimensions), vec[config.classification_dimension]);
+    };
+
+    if (config.format == data_format::binary) {
+        auto file = std::ifstream{config.filename, std::ios::binary};
+        if (!file.is_open()) {
+            throw std::invalid_argument{"File couldn't be opened!"};
+        }
+        ldnn::for_each_binary_row<double>(file, prepare);
+    } else if (config.async_load) {
+        // Prepare the chunks that have already been parsed while the reader
+        // thread continues with the rest of the file.
+        ldnn::async_csv_reader<double> reader{
+            config.filename, '\t', config.chunk_size};
+        for (auto chunk = std::vector<ldnn::vector<double>>{};
+            reader.next_chunk(chunk); ) {
+            for (auto& vec : chunk) {
+                prepare(std::move(vec));
+            }
+        }
+    } else {
+        auto file = std::ifstream{config.filename};
+        if (!file.is_open()) {
+            throw std::invalid_argument{"File couldn't be opened!"};
+        }
+        ldnn::for_each_csv_row<double>(file, '\t', prepare);
     }
+}
 
-    auto config = read_config(config_filename);
+// Loads the input data, separates the classification dimension, selects the
+// configured dimensions and normalizes every dimension to [0, 1].
+auto load_dataset(const config_t& config)
+    -> ldnn::dataset<double>
+{
+    auto result = ldnn::dataset<double>{};
+    auto stats = ldnn::column_stats<double>{};
+    for_each_example(config, [&](ldnn::vector<double>&& features,
+        double label)
+    {
+        stats.update(features);
+        result.features.push_back(std::move(features));
+        result.labels.push_back(label);
+    });
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    if (result.features.size() == 0) {
+        throw std::invalid_argument{"the input data is empty"};
+    }
 
-    std::cout << "initializing...\r" << std::flush;
+    // The column statistics are final once the last row has been seen.
+    util::for_each(util::execution::par, result.features,
+        [&](auto& vec) { stats.normalize(vec); });
+
+    return result;
+}
 
-    // Load and parse the input data.
-    auto data = ldnn::read_csv_file<double>(config.filename, '\t');
-    auto examples = ldnn::dimension_to_classification(
-        data, config.classification_dimension);
-    for (auto& cl : examples) {
-        cl.vec = ldnn::select_dimensions(cl.vec, config.dimensions);
+// Loads the same examples as load_dataset into sink one at a time, so that
+// they can be encoded without ever holding all of them at full precision.
+// The input data is read twice: first for the number of rows and the column
+// statistics, then sink.allocate(rows, rank) is called and every
+// normalized example is passed to sink.push_back(features, label).
+template<class Sink>
+void load_dataset(const config_t& config, Sink& sink)
+{
+    auto stats = ldnn::column_stats<double>{};
+    auto rows = size_t{0};
+    for_each_example(config, [&](ldnn::vector<double>&& features, double) {
+        stats.update(features);
+        rows++;
+    });
+    if (rows == 0) {
+        throw std::invalid_argument{"the input data is empty"};
     }
 
-    // Normalize the input data.
-    for (auto dim : indices<size_t>(examples[0].vec.rank().value)) {
-        auto minmax = util::minmax(examples,
-            [&](auto& c) { return c.vec[dim]; });
-        for (auto& c : examples) {
-            c.vec[dim] -= minmax.first;
-            c.vec[dim] /= minmax.second - minmax.first;
+    sink.allocate(rows, ldnn::rank_t{config.dimensions.size()});
+    auto loaded = size_t{0};
+    for_each_example(config, [&](ldnn::vector<double>&& features,
+        double label)
+    {
+        if (loaded++ == rows) {
+            throw std::runtime_error{config.filename
+                + " changed while it was loaded"};
         }
+        stats.normalize(features);
+        sink.push_back(features, label);
+    });
+    if (loaded != rows) {
+        throw std::runtime_error{config.filename
+            + " changed while it was loaded"};
     }
+}
 
-    for (auto iteration : indices(config.iterations)) {
+// Features encoded with E and their labels, to be loaded by load_dataset.
+template<class E>
+struct compact_dataset {
+    ldnn::compact_matrix<E> features;
+    std::vector<double> labels;
+
+    void allocate(size_t rows, ldnn::rank_t rank) {
+        features.reserve(rows, rank);
+        labels.reserve(rows);
+    }
+
+    void push_back(const ldnn::vector<double>& row, double label) {
+        features.push_back(row);
+        labels.push_back(label);
+    }
+};
+
+// Identifies the features and labels load_dataset returns for the file of
+// config: the way it's parsed and the encoding they're stored with.
+auto dataset_key(const config_t& config)
+    -> std::string
+{
+    auto key = std::to_string(static_cast<int>(config.format)) + " "
+        + std::to_string(config.classification_dimension) + " [";
+    for (auto d : config.dimensions) {
+        key += std::to_string(d) + ",";
+    }
+    return key + "] " + std::to_string(static_cast<int>(config.storage));
+}
+
+// Identifies what the training progress of train_binary depends on: the
+// seed, if it is configured, the dataset, the network and the settings of
+// training. The numbers of rounds and epochs are left out, so that a
+// checkpointed run can be continued with more of them.
+auto run_key(const config_t& config, const std::string& config_filename)
+    -> std::string
+{
+    auto network = ldnn::network<double>::read_config(config_filename);
+    auto key = std::ostringstream{};
+    key << std::setprecision(17);
+    if (config.has_seed) {
+        key << config.seed;
+    }
+    key << " " << ldnn::file_identity(config.filename)
+        << " " << dataset_key(config)
+        << " " << network.polytope_count << " " << network.max_halfspaces
+        << " " << network.alpha << " " << network.kmeans_iterations
+        << " " << network.inference_epsilon << " " << network.batch_size
+        << " " << static_cast<int>(network.optimizer.type)
+        << " " << network.optimizer.beta1 << " " << network.optimizer.beta2
+        << " " << network.optimizer.epsilon
+        << " " << static_cast<int>(network.optimizer.schedule)
+        << " " << network.optimizer.decay
+        << " " << network.optimizer.decay_step
+        << " " << config.peers.size() << " " << config.sync_interval
+        << " " << config.sampling.fraction << " " << config.sampling.uniform
+        << " " << config.sampling.full_pass_interval;
+    return key.str();
+}
+
+// Returns a reporter of the training progress to stdout, which also reports
+// saturated halfspaces.
+auto make_progress(const config_t& config)
+    -> std::unique_ptr<util::progress_reporter>
+{
+    auto progress = std::make_unique<util::progress_reporter>(std::cout,
+        std::chrono::milliseconds{config.progress_interval});
+    progress->watch("saturated halfspaces", ldnn::saturated_halfspaces());
+    return progress;
+}
+
+// Converts a dataset into binary examples, which are positive if their label
+// is 1.
+auto to_examples(ldnn::dataset<double>&& data)
+    -> std::vector<ldnn::network<double>::classification>
+{
+    auto examples = std::vector<ldnn::network<double>::classification>{};
+    for (auto i : indices(data.features.size())) {
+        examples.push_back({std::move(data.features[i]), data.labels[i] == 1});
+    }
+    return examples;
+}
+
+// Returns the time since start in milliseconds.
+auto milliseconds_since(std::chrono::steady_clock::time_point start)
+    -> double
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// Returns the peak resident set size of the process in MB.
+auto peak_memory()
+    -> double
+{
+    auto usage = rusage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+// Prints the metrics of a round that follow its accuracy.
+void print_evaluation(const std::string& output,
+    const ldnn::evaluation<double>& result)
+{
+    std::cout << output << "auc " << result.auc
+              << ", log-loss " << result.log_loss()
+              << ", quadratic error " << result.quadratic_error
+              << ", tp " << result.true_positives
+              << ", fp " << result.false_positives
+              << ", tn " << result.true_negatives
+              << ", fn " << result.false_negatives << "\n";
+}
+
+void train_binary(const config_t& config, const std::string& config_filename,
+    util::philox4x32 rng)
+{
+    auto load_start = std::chrono::steady_clock::now();
+    auto examples = to_examples(load_dataset(config));
+    std::cout << "loaded " << examples.size() << " examples in "
+              << milliseconds_since(load_start) << "ms\n";
+    auto progress = make_progress(config);
+
+    // Every process of a distributed run saves its own checkpoints.
+    auto checkpoint_filename = config.checkpoint;
+    if (checkpoint_filename.size() > 0 && config.peers.size() > 1) {
+        checkpoint_filename += "." + std::to_string(config.rank);
+    }
+    auto run_hash = util::fnv1a(run_key(config, config_filename));
+    auto resume_from = std::unique_ptr<ldnn::checkpoint<double>>{};
+    if (config.resume && std::ifstream{checkpoint_filename}.good()) {
+        resume_from = std::make_unique<ldnn::checkpoint<double>>(
+            ldnn::read_checkpoint_file<double>(checkpoint_filename));
+        if (resume_from->run_hash != run_hash) {
+            throw std::invalid_argument{checkpoint_filename
+                + " belongs to another seed, dataset or configuration"};
+        }
+        if (resume_from->iteration >= config.iterations
+            || resume_from->epoch > config.gradient_iterations) {
+            throw std::invalid_argument{checkpoint_filename + " is after epoch "
+                + std::to_string(resume_from->epoch) + " of round "
+                + std::to_string(resume_from->iteration + 1)
+                + ", beyond the configured training"};
+        }
+        rng = resume_from->rng;
+        std::cout << "resuming round " << resume_from->iteration + 1
+                  << " after epoch " << resume_from->epoch << "\n";
+    }
+    auto writer = std::unique_ptr<ldnn::checkpoint_writer<double>>{};
+    if (checkpoint_filename.size() > 0) {
+        writer = std::make_unique<ldnn::checkpoint_writer<double>>(
+            checkpoint_filename);
+    }
+
+    // In a distributed run, all processes use the random streams of rank 0,
+    // so that they agree on the partitioning, the initial network and the
+    // order of the examples.
+    auto comm = std::unique_ptr<ldnn::ring_communicator>{};
+    if (config.peers.size() > 1) {
+        comm = std::make_unique<ldnn::ring_communicator>(
+            config.rank, config.peers);
+        comm->broadcast(rng);
+    }
+
+    // The examples of a round are moved out of examples and back afterwards
+    // instead of being copied, so they are only held once. order holds the
+    // rows of the examples as if they were shuffled in place by the
+    // partitioning of every round, like the examples of a round are.
+    auto order = std::vector<size_t>(examples.size());
+    std::iota(begin(order), end(order), size_t{0});
+    auto first_iteration = static_cast<size_t>(
+        resume_from ? resume_from->iteration : 0);
+    for (auto iteration : indices(first_iteration)) {
+        util::shuffle(order,
+            rng.stream(iteration).stream(partition_stream));
+    }
+    for (auto iteration : indices(first_iteration, config.iterations)) {
         auto start_time = std::chrono::system_clock::now();
 
         auto output = std::to_string(iteration + 1) + "/"
             + std::to_string(config.iterations) + ": ";
         std::cout << output << "\r" << std::flush;
 
-        auto partitioning = random_partition(examples, 0.5, gen);
+        auto round_rng = rng.stream(iteration);
+        auto rows = random_partition(
+            order, 0.5, round_rng.stream(partition_stream));
+        auto partitioning = std::make_pair(take_rows(examples, rows.first),
+            take_rows(examples, rows.second));
+        // Shuffles the training examples for an epoch, and their rows along
+        // with them.
+        auto shuffle_training = [&](size_t step) {
+            util::shuffle(partitioning.first,
+                round_rng.stream(training_stream, step));
+            util::shuffle(rows.first, round_rng.stream(training_stream, step));
+        };
+        auto allocations = util::allocation_count();
+        auto init_start = std::chrono::steady_clock::now();
         auto network = ldnn::network<double>(
             ldnn::network<double>::read_config(config_filename),
-            partitioning.first, gen);
-        for (auto step : indices(config.gradient_iterations)) {
-            std::cout << output << step << "/"
-                      << config.gradient_iterations << "\r" << std::flush;
-            util::shuffle(partitioning.first, gen);
-            network.gradient_descent(partitioning.first);
+            partitioning.first, round_rng.stream(initialization_stream));
+        auto init_time = milliseconds_since(init_start);
+        auto sampler = std::unique_ptr<ldnn::importance_sampler<double>>{};
+        if (config.sampling.fraction > 0) {
+            sampler = std::make_unique<ldnn::importance_sampler<double>>(
+                config.sampling, partitioning.first.size());
         }
 
-        auto correct = size_t{0};
-        for (auto& c : partitioning.second) {
-            if ((network.classify(c.vec) > 0.5) == c.positive) {
-                correct++;
+        // Without sampling, the examples are shuffled in place every epoch,
+        // so the shuffles of the completed epochs are repeated to restore
+        // their order.
+        auto first_step = size_t{0};
+        if (resume_from && resume_from->iteration == iteration) {
+            network.set_parameters(resume_from->parameters);
+            network.set_optimizer_state(std::move(resume_from->optimizer));
+            first_step = resume_from->epoch;
+            if (sampler) {
+                sampler->set_last_errors(
+                    std::move(resume_from->sample_errors));
+            } else {
+                for (auto step : indices(first_step)) {
+                    shuffle_training(step);
+                }
             }
+            resume_from.reset();
         }
-        std::cout << 100.0 * correct / partitioning.second.size()
+
+        auto training_start = std::chrono::steady_clock::now();
+        auto observe = [&](size_t n, double squared_error) {
+            progress->add(n, squared_error);
+        };
+        progress->start(output, first_step, config.gradient_iterations);
+        for (auto step : indices(first_step, config.gradient_iterations)) {
+            progress->set_epoch(step);
+            if (sampler) {
+                ldnn::importance_epoch(network, partitioning.first, *sampler,
+                    step, round_rng.stream(training_stream, step), observe);
+            } else {
+                shuffle_training(step);
+                if (comm) {
+                    ldnn::distributed_epoch(network, partitioning.first,
+                        *comm, config.sync_interval, observe);
+                } else {
+                    network.gradient_descent(partitioning.first, observe);
+                }
+            }
+            if (writer && (step + 1) % config.checkpoint_interval == 0) {
+                writer->save({iteration, step + 1, run_hash, rng,
+                    network.parameters(), network.optimizer_state(),
+                    sampler ? sampler->last_errors() : std::vector<double>{}});
+            }
+        }
+        progress->stop();
+        std::cout << output << "initialized in " << init_time << "ms, "
+                  << milliseconds_since(training_start) / std::max<size_t>(
+                      config.gradient_iterations - first_step, 1)
+                  << "ms per epoch\n";
+        if (util::counting_allocations) {
+            std::cout << output << util::allocation_count() - allocations
+                      << " allocations during training\n";
+        }
+
+        if (config.prune_tolerance > 0) {
+            auto removed = network.prune(
+                partitioning.first, config.prune_tolerance);
+            std::cout << output << "pruned " << removed.first
+                      << " halfspaces and " << removed.second
+                      << " polytopes\n";
+        }
+
+        // Use a kernel that is specialized for the network's architecture if
+        // there is one.
+        auto compiled = ldnn::compiled_network<double>{network};
+        auto inference_start = std::chrono::steady_clock::now();
+        auto result = ldnn::evaluate(compiled, partitioning.second);
+        auto inference_time =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - inference_start).count();
+        std::cout << 100.0 * result.accuracy()
                   << "% correctly classified! ("
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::system_clock::now() - start_time).count()
+                  << "ms, "
+                  << inference_time / 1000.0 / partitioning.second.size()
+                  << "us per classification)\n";
+        print_evaluation(output, result);
+
+        if (config.quantize) {
+            auto qnetwork = ldnn::quantized_network<double>{network};
+            auto report = ldnn::compare(
+                network, qnetwork, partitioning.second);
+            auto qstart = std::chrono::steady_clock::now();
+            util::count_if(util::execution::par, partitioning.second,
+                [&](auto& c) { return qnetwork.classify(c.vec) > 0.5f; });
+            auto qtime =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - qstart).count();
+            std::cout << output << "quantized: "
+                      << 100.0 * report.quantized_accuracy << "% vs "
+                      << 100.0 * report.float_accuracy << "%, "
+                      << 100.0 * report.agreement << "% agreement, "
+                      << "mean |diff| " << report.mean_abs_diff
+                      << ", max |diff| " << report.max_abs_diff << ", "
+                      << ldnn::model_size(network) << " -> "
+                      << qnetwork.model_size() << " bytes, "
+                      << qtime / 1000.0 / partitioning.second.size()
+                      << "us per classification\n";
+        }
+
+        put_rows(examples, rows.first, std::move(partitioning.first));
+        put_rows(examples, rows.second, std::move(partitioning.second));
+    }
+}
+
+void train_one_vs_rest(const config_t& config,
+    const std::string& config_filename, const util::philox4x32& rng)
+{
+    auto data = load_dataset(config);
+
+    auto order = std::vector<size_t>(data.features.size());
+    std::iota(begin(order), end(order), size_t{0});
+
+    for (auto iteration : indices(config.iterations)) {
+        auto start_time = std::chrono::system_clock::now();
+
+        std::cout << iteration + 1 << "/" << config.iterations << ": "
+                  << "\r" << std::flush;
+
+        auto round_rng = rng.stream(iteration);
+        auto partitioning = random_partition(
+            order, 0.5, round_rng.stream(partition_stream));
+        auto classifier = ldnn::one_vs_rest<double>{
+            ldnn::network<double>::read_config(config_filename), data,
+            partitioning.first, config.gradient_iterations,
+            util::default_pool(), round_rng.stream(training_stream)};
+
+        auto correct = util::count_if(util::execution::par,
+            partitioning.second, [&](auto i) {
+                return classifier.predict(data.features[i]) == data.labels[i];
+            });
+        std::cout << 100.0 * correct / partitioning.second.size()
+                  << "% correctly classified into "
+                  << classifier.classes().size() << " classes! ("
                   << std::chrono::duration_cast<std::chrono::milliseconds>(
                       std::chrono::system_clock::now() - start_time).count()
                   << "ms)\n";
     }
+}
+
+// An example that is referred to by its row in the features of an
+// indexed_model.
+struct indexed_example {
+    size_t row;
+    bool positive;
+};
+
+// Scores indexed examples with a network, for ldnn::evaluate.
+template<class Matrix>
+struct indexed_model {
+    const ldnn::network<double>& network;
+    const Matrix& features;
+
+    template<class It>
+    auto classify_batch(It first, It last) const
+        -> std::vector<double>
+    {
+        auto result = std::vector<double>{};
+        result.reserve(static_cast<size_t>(std::distance(first, last)));
+        for (; first != last; ++first) {
+            result.push_back(network.classify(features[first->row]));
+        }
+        return result;
+    }
+};
+
+// Cross validation on examples that are referred to by their row in
+// features, so they are never copied. describe returns the part of the
+// report that is specific to the features.
+template<class Matrix, class IsPositive, class Describe>
+void train_indexed(const config_t& config, const std::string& config_filename,
+    const util::philox4x32& rng, const Matrix& features,
+    IsPositive&& is_positive, Describe&& describe)
+{
+    auto order = std::vector<size_t>(features.size());
+    std::iota(begin(order), end(order), size_t{0});
+    auto progress = make_progress(config);
+
+    for (auto iteration : indices(config.iterations)) {
+        auto start_time = std::chrono::system_clock::now();
+
+        auto output = std::to_string(iteration + 1) + "/"
+            + std::to_string(config.iterations) + ": ";
+        std::cout << output << "\r" << std::flush;
+
+        auto round_rng = rng.stream(iteration);
+        auto partitioning = random_partition(
+            order, 0.5, round_rng.stream(partition_stream));
+        auto network = ldnn::network<double>(
+            ldnn::network<double>::read_config(config_filename),
+            features, partitioning.first, is_positive,
+            round_rng.stream(initialization_stream));
+        progress->start(output, 0, config.gradient_iterations);
+        for (auto step : indices(config.gradient_iterations)) {
+            progress->set_epoch(step);
+            util::shuffle(partitioning.first,
+                round_rng.stream(training_stream, step));
+            for (auto i : partitioning.first) {
+                progress->add(1, util::square(
+                    network.gradient_descent(features[i], is_positive(i))));
+            }
+            network.next_epoch();
+        }
+        progress->stop();
+
+        auto test = std::vector<indexed_example>{};
+        test.reserve(partitioning.second.size());
+        for (auto i : partitioning.second) {
+            test.push_back({i, is_positive(i)});
+        }
+        auto inference_start = std::chrono::steady_clock::now();
+        auto result = ldnn::evaluate(
+            indexed_model<Matrix>{network, features}, test);
+        auto inference_time =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - inference_start).count();
+        std::cout << 100.0 * result.accuracy()
+                  << "% correctly classified! ("
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::system_clock::now() - start_time).count()
+                  << "ms, "
+                  << inference_time / 1000.0 / partitioning.second.size()
+                  << "us per classification, " << describe() << ")\n";
+        print_evaluation(output, result);
+    }
+}
+
+// Cross validation on sparse input data in a CSR matrix.
+void train_sparse(const config_t& config, const std::string& config_filename,
+    const util::philox4x32& rng)
+{
+    auto data = ldnn::read_libsvm_file<double>(config.filename);
+    if (data.features.size() == 0) {
+        throw std::invalid_argument{"the input data is empty"};
+    }
+    data.features.max_abs_scale();
+
+    train_indexed(config, config_filename, rng, data.features,
+        [&](size_t i) { return data.labels[i] == 1; },
+        [&] {
+            return std::to_string(data.features.nnz() / data.features.size())
+                + " of " + std::to_string(data.features.rank().value)
+                + " features non-zero on average";
+        });
+}
+
+// Cross validation on csv or binary data whose features are encoded with E
+// while loading, to fit larger datasets into memory. Training decodes each
+// example once per step.
+template<class E>
+void train_compact(const config_t& config, const std::string& config_filename,
+    const util::philox4x32& rng)
+{
+    auto load_start = std::chrono::steady_clock::now();
+    if (config.shared) {
+        auto data = ldnn::share_dataset<E>(config.filename,
+            dataset_key(config),
+            [&](auto& writer) { load_dataset(config, writer); },
+            config.persistent);
+        std::cout << (data.attached ? "attached to " : "loaded and shared ")
+                  << data.features.size() << " examples in "
+                  << milliseconds_since(load_start) << "ms\n";
+
+        train_indexed(config, config_filename, rng, data.features,
+            [&](size_t i) { return data.labels[i] == 1; },
+            [&] {
+                auto stream = std::ostringstream{};
+                stream << data.features.storage_size() / 1048576.0
+                       << "MB of shared features";
+                return stream.str();
+            });
+        return;
+    }
+
+    auto data = compact_dataset<E>{};
+    load_dataset(config, data);
+    std::cout << "loaded " << data.features.size() << " examples in "
+              << milliseconds_since(load_start) << "ms\n";
+
+    train_indexed(config, config_filename, rng, data.features,
+        [&](size_t i) { return data.labels[i] == 1; },
+        [&] {
+            auto stream = std::ostringstream{};
+            stream << data.features.storage_size() / 1048576.0
+                   << "MB of features";
+            return stream.str();
+        });
+}
+
+// Learns from the lines of a stream in the csv format of the data file until
+// it ends. Lines with a classification are used for training, after being
+// scored by the current model to report the accuracy on unseen examples.
+// Lines without a classification are scored on the thread pool, their
+// score is printed together with their line number.
+void learn_online(const config_t& config, const std::string& config_filename,
+    std::istream& stream, const util::philox4x32& rng)
+{
+    ldnn::online_learner<double> learner{
+        ldnn::network<double>::read_config(config_filename), config.online,
+        rng.stream(initialization_stream)};
+
+    std::mutex output_mutex;
+    auto scores = std::deque<std::future<void>>{};
+    // The scoring tasks refer to the learner and the mutex, so they are
+    // waited for on every way out of this function, also by an exception.
+    struct wait_for_scores {
+        std::deque<std::future<void>>& scores;
+
+        ~wait_for_scores() {
+            for (auto& score : scores) {
+                if (score.valid()) {
+                    score.wait();
+                }
+            }
+        }
+    } scores_guard{scores};
+    auto correct = size_t{0};
+    auto scored = size_t{0};
+    auto line_number = size_t{0};
+    for (auto line = std::string{}; std::getline(stream, line); ) {
+        line_number++;
+        auto vec = ldnn::parse_csv_line<double>(line, '\t');
+        if (ldnn::is_nan_vector(vec)) {
+            continue;
+        }
+        if (vec.rank().value <= config.classification_dimension) {
+            throw std::invalid_argument{"line " + std::to_string(line_number)
+                + " has too few columns"};
+        }
+        auto label = vec[config.classification_dimension];
+        auto features = ldnn::select_dimensions(ldnn::remove_dimension(
+            vec, config.classification_dimension), config.dimensions);
+
+        if (std::isnan(label)) {
+            // Score on the pool, so that training isn't blocked.
+            scores.push_back(util::default_pool().submit(
+                [&, line_number, features = std::move(features)] {
+                    auto model = learner.current();
+                    if (!model) {
+                        return;
+                    }
+                    auto score = model->classify(features);
+                    auto lock = std::unique_lock<std::mutex>{output_mutex};
+                    std::cout << line_number << "\t" << score << "\n";
+                }));
+            while (scores.size() > 0 && scores.front().wait_for(
+                std::chrono::seconds{0}) == std::future_status::ready) {
+                scores.front().get();
+                scores.pop_front();
+            }
+            continue;
+        }
+
+        auto positive = label == 1;
+        if (auto model = learner.current()) {
+            correct += (model->classify(features) > 0.5) == positive;
+            scored++;
+        }
+        if (learner.learn(std::move(features), positive)) {
+            auto model = learner.current();
+            auto lock = std::unique_lock<std::mutex>{output_mutex};
+            std::cout << "trained on " << model->examples << " examples";
+            if (scored > 0) {
+                std::cout << ", " << 100.0 * correct / scored
+                          << "% of the last " << scored
+                          << " correctly classified before training";
+            }
+            std::cout << "\n";
+            correct = 0;
+            scored = 0;
+        }
+    }
+
+    for (auto& score : scores) {
+        score.get();
+    }
+}
+
+// Evaluates the network configurations of the sweep spec on the data set of
+// the config and writes the results table to the output of the spec.
+void sweep(const config_t& config, const std::string& config_filename,
+    const std::string& spec_filename)
+{
+    auto spec = ldnn::sweep_spec<double>::read(spec_filename);
+    auto examples = to_examples(load_dataset(config));
+
+    auto results = ldnn::run_sweep(spec,
+        ldnn::network<double>::read_config(config_filename), examples,
+        config.gradient_iterations, util::default_pool());
+
+    auto file = std::ofstream{spec.output};
+    if (!file.is_open()) {
+        throw std::invalid_argument{spec.output + " couldn't be opened!"};
+    }
+    ldnn::write_sweep_results(file, results);
+    ldnn::write_sweep_results(std::cout, results);
+}
+
+int ldnn_main(int argc, char *argv[]) {
+    auto cmdopt = cxxopts::Options{
+        "ldnn", "C++ implementation of a Logistic Disjunctive Normal Network"};
+    cmdopt.add_options()
+        ("c,config", "ini config filename", cxxopts::value<std::string>())
+        ("s,sweep", "ini filename of a hyperparameter sweep spec",
+            cxxopts::value<std::string>())
+        ("r,rank", "rank of this process in a distributed run",
+            cxxopts::value<size_t>())
+        ("o,online", "learn online from a stream in the format of the data "
+            "file, - for stdin", cxxopts::value<std::string>())
+        ("resume", "continue from the checkpoint file of the config, if it "
+            "exists")
+        ("unshare", "remove the persistent shared copies of the data file of "
+            "the config and exit");
+    auto options = cmdopt.parse(argc, argv);
+    auto config_filename = "ldnn.ini"s;
+    if (options.count("config") > 0) {
+        config_filename = options["config"].as<std::string>();
+    }
+
+    auto config = read_config(config_filename);
+    util::default_concurrency() = config.threads;
+    if (options.count("rank") > 0) {
+        config.rank = options["rank"].as<size_t>();
+    }
+    config.resume = options.count("resume") > 0;
+    if (options.count("unshare") > 0) {
+        std::cout << "removed " << ldnn::unshare_dataset(config.filename)
+                  << " shared copies of " << config.filename << "\n";
+        return 0;
+    }
+    if (config.sampling.fraction > 0 && config.peers.size() > 1) {
+        throw std::invalid_argument{
+            "importance sampling is not supported in distributed runs"};
+    }
+    if (config.checkpoint_interval == 0) {
+        throw std::invalid_argument{"training.checkpoint_interval == 0"};
+    }
+
+    // Only the first process of a distributed run reports its progress.
+    if (config.peers.size() > 1 && config.rank != 0) {
+        std::cout.rdbuf(nullptr);
+    }
+
+    auto seed = config.seed;
+    if (!config.has_seed) {
+        std::random_device rd;
+        seed = (uint64_t{rd()} << 32) | rd();
+        std::cout << "seed: " << seed << "\n";
+    }
+    auto rng = util::philox4x32{seed};
+
+    std::cout << "initializing...\r" << std::flush;
+
+    if (config.format == data_format::libsvm
+        && (options.count("sweep") > 0 || config.multiclass
+            || options.count("online") > 0)) {
+        throw std::invalid_argument{
+            "sweeps, multiclass and online training require csv data"};
+    }
 
+    // libsvm data, compact and shared features are trained on one row at a
+    // time.
+    auto batch_size =
+        ldnn::network<double>::read_config(config_filename).batch_size;
+    if (config.format == data_format::libsvm
+        && (config.peers.size() > 1 || config.sampling.fraction > 0
+            || config.checkpoint.size() > 0 || config.prune_tolerance > 0
+            || config.quantize || batch_size > 1)) {
+        throw std::invalid_argument{
+            "libsvm data is only supported for cross validation on a single "
+            "process without sampling, checkpoints, pruning, quantization "
+            "and batches"};
+    }
+    if ((config.storage != feature_storage::double_precision || config.shared)
+        && (config.format == data_format::libsvm
+            || options.count("sweep") > 0 || config.multiclass
+            || options.count("online") > 0 || config.peers.size() > 1
+            || config.sampling.fraction > 0 || config.checkpoint.size() > 0
+            || config.prune_tolerance > 0 || config.quantize
+            || batch_size > 1)) {
+        throw std::invalid_argument{
+            "data.shared and data.storage other than double are only "
+            "supported for cross validation of csv or binary data on a "
+            "single process without sampling, checkpoints, pruning, "
+            "quantization and batches"};
+    }
+
+    if (options.count("online") > 0) {
+        auto stream_name = options["online"].as<std::string>();
+        if (stream_name == "-") {
+            learn_online(config, config_filename, std::cin, rng);
+        } else {
+            // A FIFO blocks here until a writer opens it.
+            auto stream = std::ifstream{stream_name};
+            if (!stream.is_open()) {
+                throw std::invalid_argument{
+                    stream_name + " couldn't be opened!"};
+            }
+            learn_online(config, config_filename, stream, rng);
+        }
+    } else if (options.count("sweep") > 0) {
+        sweep(config, config_filename, options["sweep"].as<std::string>());
+    } else if (config.multiclass) {
+        train_one_vs_rest(config, config_filename, rng);
+    } else if (config.format == data_format::libsvm) {
+        train_sparse(config, config_filename, rng);
+    } else if (config.storage == feature_storage::float16) {
+        train_compact<ldnn::float16>(config, config_filename, rng);
+    } else if (config.storage == feature_storage::bfloat16) {
+        train_compact<ldnn::bfloat16>(config, config_filename, rng);
+    } else if (config.storage == feature_storage::fixed8) {
+        train_compact<ldnn::fixed8>(config, config_filename, rng);
+    } else if (config.shared) {
+        train_compact<ldnn::float64>(config, config_filename, rng);
+    } else {
+        train_binary(config, config_filename, rng);
+    }
+
+    std::cout << "peak memory: " << peak_memory() << "MB\n";
+    if (ldnn::saturated_halfspaces() > 0) {
+        std::cout << ldnn::saturated_halfspaces()
+                  << " halfspace evaluations saturated to 0\n";
+    }
     return 0;
 }
 
@@ -150,9 +1135,10 @@ int main(int argc, char *argv[]) {
         return ldnn_main(argc, argv);
     }
     catch (const std::exception& e) {
-        std::cout << "ERROR: " << e.what() << "\n";
+        std::cerr << "ERROR: " << e.what() << "\n";
     }
     catch(...) {
-        std::cout << "an unexpected error occurred" << "\n";
+        std::cerr << "an unexpected error occurred" << "\n";
     }
+    return 1;
 }